@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+# 端到端扩展性基准测试
+# 用 gen_sysy 生成规模递增的程序, 分别以 -koopa 与 -riscv 模式编译,
+# 记录吞吐量 (行/秒, 字节/秒) 与常驻内存峰值, 结果同时写入 results.csv
+# expr / logic 等形状的程序行数很少, 以字节/秒衡量吞吐量;
+# 同一形状下字节吞吐量跌到最小规模的一半以下时标记 SUPERLINEAR
+# 计时只包含不带报告选项的编译, 内存峰值由另一次编译测得:
+# 有 /usr/bin/time 时取其 %M, 否则取 -mem-report-json 中各阶段的最大值
+# 用法: bench.sh 编译器 gen_sysy 工作目录
+set -euo pipefail
+
+COMPILER=${1:?compiler}
+GEN=${2:?gen_sysy}
+WORK_DIR=${3:?work dir}
+# 各形状的规模, 可通过环境变量覆盖
+FUNCS_SIZES=${FUNCS_SIZES:-"1000 4000 16000 64000"}
+CONSTS_SIZES=${CONSTS_SIZES:-"1000 4000 16000 64000"}
+EXPR_SIZES=${EXPR_SIZES:-"64 128 256 512"}
+BLOCKS_SIZES=${BLOCKS_SIZES:-"64 128 256 512"}
+LOGIC_SIZES=${LOGIC_SIZES:-"256 1024 4096 16384"}
+MIXED_SIZES=${MIXED_SIZES:-"250 1000 4000"}
+
+mkdir -p "$WORK_DIR"
+RESULTS="$WORK_DIR/results.csv"
+echo "shape,size,mode,lines,bytes,seconds,lines_per_sec,bytes_per_sec,peak_rss_kb" > "$RESULTS"
+
+now_ns() {
+  date +%s%N
+}
+
+# 另编译一次, 输出常驻内存峰值 (KiB)
+# 用法: peak_rss 模式 源文件 输出文件 临时文件
+peak_rss() {
+  if [ -x /usr/bin/time ]; then
+    /usr/bin/time -f %M -o "$4" "$COMPILER" "$1" "$2" -o "$3"
+    tail -1 "$4"
+  else
+    "$COMPILER" "$1" "$2" -o "$3" -mem-report-json "$4"
+    grep -o '"rss_peak_kb":[0-9]*' "$4" | cut -d: -f2 | sort -n | tail -1
+  fi
+}
+
+run_shape() {
+  local shape=$1
+  shift
+  for mode in -koopa -riscv; do
+    local base_rate=""
+    for size in "$@"; do
+      local src="$WORK_DIR/$shape-$size.c"
+      local out="$WORK_DIR/$shape-$size${mode/-/.}"
+      local mem="$WORK_DIR/$shape-$size${mode/-/.}.mem"
+      [ -f "$src" ] || "$GEN" "$shape" "$size" > "$src"
+      local lines bytes
+      lines=$(wc -l < "$src")
+      bytes=$(wc -c < "$src")
+      local start end
+      start=$(now_ns)
+      "$COMPILER" "$mode" "$src" -o "$out"
+      end=$(now_ns)
+      local seconds rate byte_rate peak
+      seconds=$(awk -v ns=$((end - start)) 'BEGIN { printf "%.4f", ns / 1e9 }')
+      rate=$(awk -v n="$lines" -v s="$seconds" 'BEGIN { printf "%.0f", (s > 0 ? n / s : 0) }')
+      byte_rate=$(awk -v n="$bytes" -v s="$seconds" 'BEGIN { printf "%.0f", (s > 0 ? n / s : 0) }')
+      peak=$(peak_rss "$mode" "$src" "$out" "$mem")
+      local flag=""
+      if [ -z "$base_rate" ]; then
+        base_rate=$byte_rate
+      elif awk -v r="$byte_rate" -v b="$base_rate" 'BEGIN { exit !(r * 2 < b) }'; then
+        flag="SUPERLINEAR"
+      fi
+      printf "%-7s %8s %-7s %9s lines %9ss %12s lines/s %12s B/s %9s KiB %s\n" \
+        "$shape" "$size" "$mode" "$lines" "$seconds" "$rate" "$byte_rate" "$peak" "$flag"
+      echo "$shape,$size,$mode,$lines,$bytes,$seconds,$rate,$byte_rate,$peak" >> "$RESULTS"
+    done
+  done
+}
+
+run_shape funcs $FUNCS_SIZES
+run_shape consts $CONSTS_SIZES
+run_shape expr $EXPR_SIZES
+run_shape blocks $BLOCKS_SIZES
+run_shape logic $LOGIC_SIZES
+run_shape mixed $MIXED_SIZES
+
+echo "results written to $RESULTS"
@@ -0,0 +1,5 @@
+int main() {
+  const int a = 10, b = a * 3 + 7;
+  const int c = (b - a) / 4 % 5;
+  return -c + !a + +b;
+}
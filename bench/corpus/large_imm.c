@@ -0,0 +1,16 @@
+int small() {
+  return 2047;
+}
+
+int edge() {
+  return -2048;
+}
+
+int large() {
+  const int x = 65536;
+  return x * 3 + 1;
+}
+
+int main() {
+  return 100000;
+}
@@ -0,0 +1,5 @@
+int main() {
+  const int a = 3, b = 0;
+  const int c = a && b || a < 5 && b != 1;
+  return c + (a >= 3) * 2 + (b == 0 || a > 9);
+}
@@ -0,0 +1,21 @@
+int f() {
+  const int a = 1;
+  {
+    const int a = 2;
+    {
+      const int b = a * 10;
+      return b + a;
+    }
+  }
+}
+
+int main() {
+  const int a = 7;
+  {
+    const int b = a + 1;
+    {
+      const int a = b * b;
+      return a - b;
+    }
+  }
+}
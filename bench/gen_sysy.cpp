@@ -0,0 +1,194 @@
+// SysY 负载生成器
+// 生成规模可调的 SysY 程序, 用于端到端的扩展性基准测试 (make bench)
+// 用法: gen_sysy 形状 规模 [随机种子]
+//   funcs   规模个小函数
+//   consts  一个函数中有规模个 const 定义
+//   expr    嵌套深度为规模的表达式
+//   blocks  嵌套深度为规模的语句块, 每层定义一个常量
+//   logic   长度为规模的 && / || 链
+//   mixed   规模个函数, 每个函数同时包含以上各种结构
+// 生成的程序只使用当前前端支持的语法: 函数定义、const 定义、语句块与 return
+// 所有运算只使用 + - * %, 并及时取模, 常量值不会溢出
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief 线性同余随机数生成器，保证相同种子生成相同程序
+ */
+class Random {
+private:
+    uint64_t state;
+public:
+    explicit Random(uint64_t seed) : state(seed * 6364136223846793005ULL + 1442695040888963407ULL) {}
+    int next(int bound) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (int)((state >> 33) % (uint64_t)bound);
+    }
+};
+
+/**
+ * @brief 程序生成器
+ */
+class Generator {
+private:
+    Random random;
+    string out;
+    int func_count = 0;
+
+    /**
+     * @brief 生成嵌套深度为 depth 的表达式，以 base 为最内层操作数
+     * @note 每四层取一次模，值保持在 [-1009 * 3, 1009 * 3] 之间
+     */
+    void expr(const string& base, int depth) {
+        for (int i = 0; i < depth; ++i) {
+            out += '(';
+        }
+        out += base;
+        for (int i = 0; i < depth; ++i) {
+            switch (i % 4) {
+            case 0: out += " + " + to_string(random.next(100)); break;
+            case 1: out += " - " + to_string(random.next(100)); break;
+            case 2: out += " * 3"; break;
+            default: out += " % 1009"; break;
+            }
+            out += ')';
+        }
+    }
+
+    /**
+     * @brief 生成 count 个 const 定义，每行最多 8 个，后面的常量引用前面的常量
+     */
+    void consts(const string& prefix, int count) {
+        for (int i = 0; i < count; ++i) {
+            out += i % 8 == 0 ? "  const int " : ", ";
+            out += prefix + to_string(i) + " = ";
+            if (i == 0) {
+                out += to_string(random.next(1000));
+            }
+            else {
+                out += "(" + prefix + to_string(i - 1) + " * 3 + " + to_string(random.next(100)) + ") % 1009";
+            }
+            if (i % 8 == 7 || i + 1 == count) {
+                out += ";\n";
+            }
+        }
+    }
+
+    /**
+     * @brief 生成长度为 count 的 && / || 链，操作数为前缀为 prefix 的常量
+     */
+    void logic(const string& prefix, int count, int consts_count) {
+        for (int i = 0; i < count; ++i) {
+            if (i > 0) {
+                out += random.next(2) ? " && " : " || ";
+            }
+            out += prefix + to_string(random.next(consts_count)) + " % 2";
+        }
+    }
+
+    /**
+     * @brief 生成深度为 depth 的嵌套语句块，每层定义一个引用外层常量的常量，最内层返回
+     */
+    void blocks(int depth) {
+        out += "  const int b0 = " + to_string(random.next(1000)) + ";\n";
+        for (int i = 1; i <= depth; ++i) {
+            out += "  { const int b" + to_string(i) + " = (b" + to_string(i - 1) + " + " + to_string(random.next(100)) + ") % 1009;\n";
+        }
+        out += "  return b" + to_string(depth) + ";\n";
+        for (int i = 1; i <= depth; ++i) {
+            out += "  }\n";
+        }
+    }
+
+    void begin_func() {
+        out += "int f" + to_string(func_count++) + "() {\n";
+    }
+
+    void end_func() {
+        out += "}\n\n";
+    }
+public:
+    explicit Generator(uint64_t seed) : random(seed) {}
+
+    string generate(const string& shape, int size) {
+        if (shape == "funcs") {
+            for (int i = 0; i < size; ++i) {
+                begin_func();
+                consts("c", 4);
+                out += "  return ";
+                expr("c3", 4);
+                out += ";\n";
+                end_func();
+            }
+        }
+        else if (shape == "consts") {
+            begin_func();
+            consts("c", size);
+            out += "  return c" + to_string(size - 1) + ";\n";
+            end_func();
+        }
+        else if (shape == "expr") {
+            begin_func();
+            out += "  return ";
+            expr(to_string(random.next(1000)), size);
+            out += ";\n";
+            end_func();
+        }
+        else if (shape == "blocks") {
+            begin_func();
+            blocks(size);
+            end_func();
+        }
+        else if (shape == "logic") {
+            begin_func();
+            consts("c", 16);
+            out += "  return ";
+            logic("c", size, 16);
+            out += ";\n";
+            end_func();
+        }
+        else if (shape == "mixed") {
+            for (int i = 0; i < size; ++i) {
+                begin_func();
+                consts("c", 20);
+                out += "  const int e = ";
+                expr("c19", 16);
+                out += ";\n  const int l = ";
+                logic("c", 16, 20);
+                out += ";\n";
+                blocks(4);
+                end_func();
+            }
+        }
+        else {
+            return "";
+        }
+        out += "int main() {\n  return 0;\n}\n";
+        return move(out);
+    }
+};
+
+int main(int argc, const char* argv[]) {
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << " funcs|consts|expr|blocks|logic|mixed size [seed]" << endl;
+        return 1;
+    }
+    string shape = argv[1];
+    int size = atoi(argv[2]);
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    if (size <= 0) {
+        cerr << "size must be positive" << endl;
+        return 1;
+    }
+    auto program = Generator(seed).generate(shape, size);
+    if (program.empty()) {
+        cerr << "unknown shape " << shape << endl;
+        return 1;
+    }
+    cout << program;
+    return 0;
+}
@@ -0,0 +1,212 @@
+// 组件微基准测试
+// 分别测量 lexer、parser、名字解析、Result 格式化与 Riscv 指令输出的单次操作耗时,
+// 每项重复多轮, 输出 ns/op 的最小值、中位数与 p99, 用于判断热点路径上的改动是否退化
+// 用法: microbench [轮数, 默认 31] [名称过滤, 只运行名称包含该字符串的项]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "include/context.hpp"
+#include "sysy.tab.hpp"
+
+using namespace std;
+
+// 可重入 lexer 的接口, 由 flex 生成
+struct yy_buffer_state;
+int yylex_init_extra(CompilerContext *extra, yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+void yy_delete_buffer(yy_buffer_state *buffer, yyscan_t scanner);
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+
+// 保存测试结果, 防止被测代码被优化掉
+static volatile size_t sink;
+
+/**
+ * @brief 基准测试运行器
+ * @note 每项先预热一轮，再重复 repeats 轮，每轮的总耗时除以操作数得到一个 ns/op 样本
+ */
+class Runner {
+private:
+    size_t repeats;
+    string filter;
+public:
+    Runner(size_t repeats, string filter) : repeats(repeats), filter(move(filter)) {}
+
+    /**
+     * @brief 运行一项基准测试
+     * @param[in] name 名称
+     * @param[in] body 运行一轮，返回该轮的操作数
+     */
+    template <typename F>
+    void run(const string& name, F&& body) {
+        run(name, [] {}, body);
+    }
+
+    /**
+     * @brief 运行一项需要逐轮准备的基准测试
+     * @param[in] name 名称
+     * @param[in] setup 每轮开始前调用，不计入耗时
+     * @param[in] body 运行一轮，返回该轮的操作数
+     */
+    template <typename S, typename F>
+    void run(const string& name, S&& setup, F&& body) {
+        if (name.find(filter) == string::npos) {
+            return;
+        }
+        setup();
+        body();
+        vector<double> samples;
+        for (size_t i = 0; i < repeats; ++i) {
+            setup();
+            auto start = chrono::steady_clock::now();
+            size_t ops = body();
+            auto end = chrono::steady_clock::now();
+            samples.push_back(chrono::duration<double, nano>(end - start).count() / max<size_t>(ops, 1));
+        }
+        sort(samples.begin(), samples.end());
+        auto p99 = samples[min(samples.size() - 1, (samples.size() * 99 + 99) / 100 - 1)];
+        printf("%-28s %10.2f %10.2f %10.2f\n", name.c_str(), samples.front(), samples[samples.size() / 2], p99);
+    }
+};
+
+/**
+ * @brief 生成用于 lexer 与 parser 测试的源程序
+ * @param[in] funcs 函数个数
+ */
+static string make_source(int funcs) {
+    string source;
+    for (int i = 0; i < funcs; ++i) {
+        auto id = to_string(i);
+        source += "int f" + id + "() {\n";
+        source += "  const int a = " + id + ", b = a * 3 + 7, c = (a + b) % 1009;\n";
+        source += "  { const int d = a - b * c / 5; return d && a || !b + -c; }\n";
+        source += "}\n";
+    }
+    return source;
+}
+
+/**
+ * @brief 扫描编译上下文中载入的整个源程序，返回 token 数
+ * @note 标识符驻留在 ctx.interner 中，第一轮之后每个标识符只做查找
+ */
+static size_t lex_all(CompilerContext& ctx) {
+    yyscan_t scanner;
+    yylex_init_extra(&ctx, &scanner);
+    auto buffer = yy_scan_buffer(ctx.source.data(), ctx.source.scan_size(), scanner);
+    YYSTYPE value;
+    size_t tokens = 0;
+    int token;
+    while ((token = yylex(&value, scanner)) != 0) {
+        ++tokens;
+    }
+    yy_delete_buffer(buffer, scanner);
+    yylex_destroy(scanner);
+    return tokens;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t repeats = argc > 1 ? strtoul(argv[1], nullptr, 10) : 31;
+    Runner runner(max<size_t>(repeats, 1), argc > 2 ? argv[2] : "");
+    printf("%-28s %10s %10s %10s\n", "benchmark (ns/op)", "min", "median", "p99");
+
+    // lexer: 每个 token 为一次操作
+    auto text = make_source(2000);
+    CompilerContext lex_ctx;
+    lex_ctx.source.load(string(text));
+    runner.run("lex/token", [&] {
+        return lex_all(lex_ctx);
+    });
+
+    // parser: 包含 lexer 与 AST 构建, 每个 token 为一次操作
+    // 每轮使用新的编译上下文, 构造上下文、复制源程序与释放上一轮的 AST 不计入耗时
+    size_t tokens = lex_all(lex_ctx);
+    unique_ptr<CompilerContext> parse_ctx;
+    auto new_parse_ctx = [&] {
+        parse_ctx = make_unique<CompilerContext>();
+        parse_ctx->source.load(string(text));
+    };
+    runner.run("parse/token", new_parse_ctx, [&] {
+        parse_ctx->parse();
+        return tokens;
+    });
+    // parser: 每个 AST 节点为一次操作
+    Stats stats;
+    {
+        CompilerContext ctx;
+        ctx.stats = &stats;
+        ctx.source.load(string(text));
+        ctx.parse();
+    }
+    size_t nodes = 0;
+    for (auto& [type, count] : stats.ast_nodes) {
+        nodes += count;
+    }
+    runner.run("parse/ast-node", new_parse_ctx, [&] {
+        parse_ctx->parse();
+        return nodes;
+    });
+    parse_ctx.reset();
+
+    // 名字解析: 8 层嵌套作用域, 每层 32 个符号, 符号以驻留编号 0..31 为键
+    const int depth = 8, symbols = 32;
+    runner.run("bind/define", [&] {
+        Binder binder;
+        binder.enter_function();
+        for (int d = 0; d < depth; ++d) {
+            binder.enter_scope();
+            for (int i = 0; i < symbols; ++i) {
+                sink = sink + binder.define(i).slot;
+            }
+        }
+        for (int d = 0; d < depth; ++d) {
+            binder.exit_scope();
+        }
+        binder.exit_function();
+        return (size_t)depth * symbols;
+    });
+    Binder binder;
+    binder.enter_function();
+    for (int d = 0; d < depth; ++d) {
+        binder.enter_scope();
+        // 第 d 层只定义下标与 d 同余的符号, 符号定义在不同的层中
+        for (int i = d; i < symbols; i += depth) {
+            binder.define(i);
+        }
+    }
+    runner.run("bind/resolve", [&] {
+        for (int r = 0; r < 100; ++r) {
+            for (int i = 0; i < symbols; ++i) {
+                sink = sink + binder.resolve(i).slot;
+            }
+        }
+        return (size_t)100 * symbols;
+    });
+
+    // Result 格式化
+    OutputBuffer buffer;
+    runner.run("result/format", [&] {
+        buffer.clear();
+        for (int i = 0; i < 100000; ++i) {
+            buffer << (i % 2 ? REG_(i) : IMM_(-i)) << ' ';
+        }
+        return (size_t)100000;
+    });
+
+    // Riscv 指令输出, 只写入内存缓冲区
+    runner.run("riscv/emit", [&] {
+        Riscv riscv;
+        for (int i = 0; i < 100000; i += 4) {
+            riscv._li("t0", i);
+            riscv._addi("t1", "t0", -i % 2048);
+            riscv._sw("t1", "sp", i % 2048);
+            riscv._add("a0", "t0", "t1");
+        }
+        sink = sink + riscv.buffer.size();
+        return (size_t)100000;
+    });
+    return 0;
+}
@@ -0,0 +1,80 @@
+// RISC-V 汇编输出基准测试
+// 用 Riscv 类生成一百万条指令, 比较逐条 endl 刷新的 ofstream 与缓冲区 + 后台写出线程的耗时
+// 用法: riscv_emit [输出文件, 默认 /dev/null] [指令条数, 默认 1000000]
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "include/backend_utils.hpp"
+
+using namespace std;
+
+// 每个函数包含的指令条数
+static const int insts_per_func = 1000;
+
+/**
+ * @brief 以 ofstream + endl 的方式输出指令，对应改动前的输出方式
+ */
+static void emit_ofstream(const char* path, int insts) {
+    ofstream ofs(path);
+    for (int i = 0; i < insts; i += insts_per_func) {
+        ofs << endl;
+        ofs << "\t.text" << endl;
+        ofs << "\t.globl f" << i << endl;
+        ofs << "f" << i << ":" << endl;
+        for (int j = 0; j < insts_per_func; j += 4) {
+            ofs << "\tli " << "t0" << ", " << j << endl;
+            ofs << "\taddi " << "t1" << ", " << "t0" << ", " << -j % 2048 << endl;
+            ofs << "\tsw " << "t1" << ", " << j % 2048 << "(" << "sp" << ")" << endl;
+            ofs << "\tadd " << "a0" << ", " << "t0" << ", " << "t1" << endl;
+        }
+    }
+}
+
+/**
+ * @brief 以 Riscv 类输出指令，每个函数结束后调用 flush()
+ */
+static void emit_riscv(const char* path, int insts, bool background) {
+    AsyncWriter writer;
+    if (!writer.open(path, background)) {
+        cerr << "cannot open " << path << endl;
+        exit(1);
+    }
+    Riscv emitter;
+    emitter.writer = &writer;
+    for (int i = 0; i < insts; i += insts_per_func) {
+        string name = "f" + to_string(i);
+        emitter._blank();
+        emitter._text();
+        emitter._globl(name);
+        emitter._label(name);
+        for (int j = 0; j < insts_per_func; j += 4) {
+            emitter._li("t0", j);
+            emitter._addi("t1", "t0", -j % 2048);
+            emitter._sw("t1", "sp", j % 2048);
+            emitter._add("a0", "t0", "t1");
+        }
+        emitter.flush();
+    }
+    emitter.flush(true);
+    writer.close();
+}
+
+template <typename F>
+static void measure(const char* name, int insts, F&& f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto end = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(end - start).count();
+    cout << name << ": " << ms << " ms, " << ms * 1e6 / insts << " ns/inst" << endl;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "/dev/null";
+    int insts = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    measure("ofstream + endl       ", insts, [&] { emit_ofstream(path, insts); });
+    measure("buffer + single writes", insts, [&] { emit_riscv(path, insts, false); });
+    measure("buffer + async writer ", insts, [&] { emit_riscv(path, insts, true); });
+    return 0;
+}
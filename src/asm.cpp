@@ -1,24 +1,100 @@
 #include "include/asm.hpp"
 
-// Riscv 辅助类，用于生成 riscv 汇编代码
-Riscv riscv;
+/**
+ * @brief 检查 raw program 是否只含有 visit() 能翻译的指令
+ * @param[in] program 程序
+ * @param[out] unsupported 不支持时为第一条不支持的指令，如 "alloc"、"ret binary"
+ * @return 是否全部支持
+ * @note 目前只支持没有全局变量、每条指令都是 ret 或 ret 整数常量的程序，即前端对常量表达式求值后的输出；
+ * @note 用户提供的 .koopa 文件必须先经过检查，否则不支持的指令会触发 visit() 中的断言
+ */
+bool check_supported(const koopa_raw_program_t& program, string& unsupported) {
+    if (program.values.len > 0) {
+        auto value = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[0]);
+        unsupported = value_kind_name(value->kind.tag);
+        return false;
+    }
+    for (size_t i = 0; i < program.funcs.len; ++i) {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        for (size_t j = 0; j < func->bbs.len; ++j) {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+            for (size_t k = 0; k < bb->insts.len; ++k) {
+                auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]);
+                if (inst->kind.tag != KOOPA_RVT_RETURN) {
+                    unsupported = value_kind_name(inst->kind.tag);
+                    return false;
+                }
+                auto ret = inst->kind.data.ret.value;
+                if (ret != nullptr && ret->kind.tag != KOOPA_RVT_INTEGER) {
+                    unsupported = string("ret ") + value_kind_name(ret->kind.tag);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
 
 /**
  * @brief 翻译 Koopa IR 程序
  * @param[in] program 程序
+ * @param[in] riscv 汇编输出
  */
-void visit(const koopa_raw_program_t& program) {
+void visit(const koopa_raw_program_t& program, Riscv& riscv) {
     // 翻译所有全局变量
-	visit(program.values);
+	visit(program.values, riscv);
 	// 翻译所有函数
-	visit(program.funcs);
+	if (riscv.pool != nullptr && program.funcs.len > 1) {
+		visit_parallel(program.funcs, riscv);
+	}
+	else {
+		visit(program.funcs, riscv);
+	}
+	// 插桩时在所有函数之后生成计数器转储例程
+	if (riscv.instrument) {
+		profile_runtime(riscv);
+	}
+}
+
+/**
+ * @brief 并行翻译所有函数
+ * @param[in] funcs 函数切片
+ * @param[in] riscv 汇编输出
+ * @note 每个函数写入独立的缓冲区，全部完成后按源顺序拼接，输出与串行翻译逐字节一致
+ */
+void visit_parallel(const koopa_raw_slice_t& funcs, Riscv& riscv) {
+	assert(funcs.kind == KOOPA_RSIK_FUNCTION);
+	vector<Riscv> parts(funcs.len);
+	// 各函数在不同线程中生成，分别统计后合并
+	vector<Stats> part_stats(riscv.stats != nullptr ? funcs.len : 0);
+	for (size_t i = 0; i < funcs.len; ++i) {
+		auto func = reinterpret_cast<koopa_raw_function_t>(funcs.buffer[i]);
+		parts[i].timer = riscv.timer;
+		parts[i].instrument = riscv.instrument;
+		if (riscv.stats != nullptr) {
+			parts[i].stats = &part_stats[i];
+		}
+		riscv.pool->submit([func, &parts, i] {
+			visit(func, parts[i]);
+		});
+	}
+	riscv.pool->wait();
+	for (auto& stats : part_stats) {
+		riscv.stats->merge(stats);
+	}
+
+	for (auto& part : parts) {
+		riscv.buffer << part.buffer.buffer;
+		riscv.flush();
+		riscv.profiled.insert(riscv.profiled.end(), part.profiled.begin(), part.profiled.end());
+	}
 }
 
 /**
  * @brief 翻译 Koopa IR 切片
  * @param[in] slice 切片
  */
-void visit(const koopa_raw_slice_t& slice) {
+void visit(const koopa_raw_slice_t& slice, Riscv& riscv) {
     // 切片 slice 是存储一系列元素的数组
 	// 遍历数组，对每个元素进行翻译
 	for (size_t i = 0; i < slice.len; ++i) {
@@ -26,21 +102,21 @@ void visit(const koopa_raw_slice_t& slice) {
         switch (slice.kind) {
         	case KOOPA_RSIK_FUNCTION: {
                 // 访问函数
-                visit(reinterpret_cast<koopa_raw_function_t>(ptr));
+                visit(reinterpret_cast<koopa_raw_function_t>(ptr), riscv);
                 break;
             }
             case KOOPA_RSIK_BASIC_BLOCK: {
                 // 访问基本块
-                visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr));
+                visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr), riscv);
                 break;
             }
             case KOOPA_RSIK_VALUE: {
                 // 访问指令
-                visit(reinterpret_cast<koopa_raw_value_t>(ptr));
+                visit(reinterpret_cast<koopa_raw_value_t>(ptr), riscv);
                 break;
             }
             default: {
-                cout << slice.kind << endl;
+                // 其他类型的切片已由 check_supported() 排除
                 assert(false);
             }
         }
@@ -51,50 +127,70 @@ void visit(const koopa_raw_slice_t& slice) {
  * @brief 翻译 Koopa IR 函数
  * @param[in] func 函数
  */
-void visit(const koopa_raw_function_t& func) {
+void visit(const koopa_raw_function_t& func, Riscv& riscv) {
 
     if (func->bbs.len == 0) {
         // 空函数，不做任何处理
         return;
     }
+    TimeScope scope(riscv.timer, "codegen", func->name + 1);
+
+    riscv._blank();
 
-    riscv_ofs << endl;
-    
     riscv._text();
     riscv._globl(func->name + 1);
     riscv._label(func->name + 1);
+    riscv.func_name = func->name + 1;
+    if (riscv.instrument) {
+        profile_prologue(riscv);
+    }
 
     // 访问所有基本块
-    visit(func->bbs);
+    visit(func->bbs, riscv);
+
+    if (riscv.instrument) {
+        // 函数的计数器：调用次数、周期数、指令数，之后是函数名
+        riscv._blank();
+        riscv._data();
+        riscv._align(2);
+        riscv._label("__prof_" + riscv.func_name);
+        riscv._word(0);
+        riscv._word(0);
+        riscv._word(0);
+        riscv._asciz(riscv.func_name);
+        riscv.profiled.push_back(riscv.func_name);
+    }
+
+    // 函数生成完毕，缓冲区足够大时交给写出线程
+    riscv.flush();
 }
 
 /**
  * @brief 翻译 Koopa IR 基本块
  * @param[in] bb 基本块
  */
-void visit(const koopa_raw_basic_block_t& bb) {
+void visit(const koopa_raw_basic_block_t& bb, Riscv& riscv) {
     
     // 输出基本块标号
     // riscv_ofs << bb->name + 1 << ":" << endl;
     // 访问所有指令
-    visit(bb->insts);
+    visit(bb->insts, riscv);
 }
 
 /**
  * @brief 翻译 Koopa IR 指令
  * @param[in] value 指令
  */
-void visit(const koopa_raw_value_t& value) {
+void visit(const koopa_raw_value_t& value, Riscv& riscv) {
     // 根据指令类型判断后续需要如何访问
     const auto &kind = value->kind;
     switch (kind.tag) {
         case KOOPA_RVT_RETURN:
             // 访问 return 指令
-            visit(kind.data.ret);
+            visit(kind.data.ret, riscv);
             break;
         default:
-            // 其他类型暂时遇不到
-            cout << kind.tag << endl;
+            // 其他指令已由 check_supported() 排除
             assert(false);
     }
 }
@@ -104,18 +200,121 @@ void visit(const koopa_raw_value_t& value) {
  * @brief 处理return指令
  * @param[in] ret 指令
  */
-void visit(const koopa_raw_return_t& ret) {
+void visit(const koopa_raw_return_t& ret, Riscv& riscv) {
     if (ret.value != nullptr) {
     	switch (ret.value->kind.tag) {
             case KOOPA_RVT_INTEGER: 
                 riscv._li("a0", ret.value->kind.data.integer.value);
 			    break;
             default:
-            // 其他类型暂时遇不到
-            cout << ret.value->kind.tag << endl;
+            // 其他返回值已由 check_supported() 排除
             assert(false);
         }
     }
 
+    if (riscv.instrument) {
+        profile_epilogue(riscv);
+    }
+    riscv._ret();
+}
+
+/**
+ * @brief 插桩函数入口，记录进入时的周期数与指令数
+ * @param[in] riscv 汇编输出
+ * @note 在函数自身的栈帧之外另开 16 字节：0(sp) 周期数，4(sp) 指令数，8(sp) ra，12(sp) 转储时暂存返回值
+ * @note 记录保存在栈上而不是计数器中，递归调用也能正确计数
+ */
+void profile_prologue(Riscv& riscv) {
+    riscv._addi("sp", "sp", -16);
+    riscv._sw("ra", "sp", 8);
+    riscv._rdinstret("t0");
+    riscv._sw("t0", "sp", 4);
+    riscv._rdcycle("t0");
+    riscv._sw("t0", "sp", 0);
+}
+
+/**
+ * @brief 插桩函数出口，将本次调用的周期数与指令数累加到函数的计数器
+ * @param[in] riscv 汇编输出
+ * @note 只使用 t0-t3，不影响 a0 中的返回值；main 返回前调用 __prof_dump 输出全部计数器
+ * @note 计数器为 32 位，运行时间很长时会回绕
+ */
+void profile_epilogue(Riscv& riscv) {
+    riscv._rdcycle("t0");
+    riscv._rdinstret("t1");
+    riscv._lw("t3", "sp", 0);
+    riscv._sub("t0", "t0", "t3");
+    riscv._lw("t3", "sp", 4);
+    riscv._sub("t1", "t1", "t3");
+    riscv._la("t2", "__prof_" + riscv.func_name);
+    riscv._lw("t3", "t2", 0);
+    riscv._addi("t3", "t3", 1);
+    riscv._sw("t3", "t2", 0);
+    riscv._lw("t3", "t2", 4);
+    riscv._add("t3", "t3", "t0");
+    riscv._sw("t3", "t2", 4);
+    riscv._lw("t3", "t2", 8);
+    riscv._add("t3", "t3", "t1");
+    riscv._sw("t3", "t2", 8);
+    if (riscv.func_name == "main") {
+        riscv._sw("a0", "sp", 12);
+        riscv._call("__prof_dump");
+        riscv._lw("a0", "sp", 12);
+    }
+    riscv._lw("ra", "sp", 8);
+    riscv._addi("sp", "sp", 16);
+}
+
+/**
+ * @brief 生成计数器转储例程
+ * @param[in] riscv 汇编输出，profiled 中为全部已插桩的函数
+ * @note __prof_dump 依次对每个函数调用 __prof_print，
+ * @note 后者通过运行时库的 putch / putint 向 stdout 输出一行 "函数名 调用次数 周期数 指令数"
+ */
+void profile_runtime(Riscv& riscv) {
+    riscv._blank();
+    riscv._text();
+    riscv._globl("__prof_dump");
+    riscv._label("__prof_dump");
+    riscv._addi("sp", "sp", -16);
+    riscv._sw("ra", "sp", 12);
+    for (auto& name : riscv.profiled) {
+        riscv._la("a0", "__prof_" + name);
+        riscv._call("__prof_print");
+    }
+    riscv._lw("ra", "sp", 12);
+    riscv._addi("sp", "sp", 16);
+    riscv._ret();
+
+    // a0 为计数器地址，函数名紧跟在 3 个计数器之后
+    riscv._blank();
+    riscv._globl("__prof_print");
+    riscv._label("__prof_print");
+    riscv._addi("sp", "sp", -16);
+    riscv._sw("ra", "sp", 12);
+    riscv._sw("s0", "sp", 8);
+    riscv._sw("s1", "sp", 4);
+    riscv._mv("s0", "a0");
+    riscv._addi("s1", "s0", 12);
+    riscv._label(".Lprof_name");
+    riscv._lbu("a0", "s1", 0);
+    riscv._beqz("a0", ".Lprof_counters");
+    riscv._call("putch");
+    riscv._addi("s1", "s1", 1);
+    riscv._jump(".Lprof_name");
+    riscv._label(".Lprof_counters");
+    for (int bias = 0; bias < 12; bias += 4) {
+        riscv._li("a0", ' ');
+        riscv._call("putch");
+        riscv._lw("a0", "s0", bias);
+        riscv._call("putint");
+    }
+    riscv._li("a0", '\n');
+    riscv._call("putch");
+    riscv._lw("s1", "sp", 4);
+    riscv._lw("s0", "sp", 8);
+    riscv._lw("ra", "sp", 12);
+    riscv._addi("sp", "sp", 16);
     riscv._ret();
+    riscv.profiled.clear();
 }
\ No newline at end of file
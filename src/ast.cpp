@@ -1,19 +1,13 @@
 #include "include/ast.hpp"
+#include "include/context.hpp"
 
 
-// 全局符号表
-SymbolTable global_symbol_table;
-// 局部符号表
-SymbolTable* local_symbol_table = &global_symbol_table;
-// 全局环境管理器
-EnvironmentManager environment_manager;
-
 /**
  * @brief 打印程序根节点 ProgramAST
  * */
-Result ProgramAST::print() const {
+Result ProgramAST::print(CompilerContext& ctx) const {
     for (auto &comp_unit : comp_units) {
-        comp_unit->print();
+        comp_unit->print(ctx);
     }
     return Result();
 }
@@ -22,39 +16,25 @@ Result ProgramAST::print() const {
 /**
  * @brief 打印函数定义 FuncDefAST
  * */
-Result FuncDefAST::print() const {
-    koopa_ofs << endl;
-
+Result FuncDefAST::print(CompilerContext& ctx) const {
+    TimeScope scope(ctx.timer, "lower", ident);
     // 函数体内必然非全局环境
-    environment_manager.is_global = false;
-    // 保存当前局部符号表
-    SymbolTable* parent_symbol_table = local_symbol_table;
-    // 创建新的局部符号表
-    local_symbol_table = new SymbolTable();
-    // 设置父符号表
-    local_symbol_table->set_parent(parent_symbol_table);
-    // 清空全局环境管理器的 is_symbol_allocated，因为不同函数体内是独立的
-    environment_manager.is_symbol_allocated.clear();
+    ctx.environment_manager.is_global = false;
+    // 函数的符号存放在扁平数组中，槽位由名字解析分配
+    ctx.local_symbols.assign(slots, Symbol());
     // 清空临时寄存器计数器
-    environment_manager.temp_count = 0;
+    ctx.environment_manager.temp_count = 0;
+    // 短路求值的标签只在函数内可见，每个函数重新计数，使函数的输出只取决于函数本身
+    ctx.environment_manager.short_circuit_count = 0;
 
-    koopa_ofs << "fun @" << ident;
-    koopa_ofs << "(";
     // todo 参数列表
-    koopa_ofs << ")";
-
-    if (func_type == FuncType::INT) {
-        koopa_ofs << ": i32"; 
-    } else {
-        koopa_ofs << ": void";
-    }
-    koopa_ofs << " {" << endl;
-    koopa_ofs << "%" << ident << "_entry:" << endl;
+    ctx.koopa->_fun(ident, func_type == FuncType::INT);
+    ctx.koopa->_label("%" + string(ident) + "_entry");
 
     // 打印函数体
-    block->print();  
+    block->print(ctx);  
 
-    koopa_ofs << "}" << endl;
+    ctx.koopa->_end_fun();
 
     // // 打印函数返回语句
     // f (func_type == FuncType::INT) {
@@ -65,11 +45,8 @@ Result FuncDefAST::print() const {
     // }
     // koopa_ofs << "}" << endl;
 
-    // 恢复父符号表
-    delete local_symbol_table;
-    local_symbol_table = parent_symbol_table;
     // 恢复全局环境状态
-    environment_manager.is_global = true;
+    ctx.environment_manager.is_global = true;
     
     return Result();
 }
@@ -77,9 +54,9 @@ Result FuncDefAST::print() const {
 /**
  * @brief 打印函数体
  * */
-Result BlockAST::print() const {
+Result BlockAST::print(CompilerContext& ctx) const {
     for (auto &block_item : block_items) {
-        block_item->print();
+        block_item->print(ctx);
     }
     return Result();
 }
@@ -87,10 +64,10 @@ Result BlockAST::print() const {
 /**
  * @brief 打印常量定义列表
  * */
- Result ConstDeclAST::print() const {
+ Result ConstDeclAST::print(CompilerContext& ctx) const {
     // 遍历常量声明列表
     for (auto& item : const_defs) {
-        item->print();
+        item->print(ctx);
     }
     return Result();
 }
@@ -98,20 +75,18 @@ Result BlockAST::print() const {
 /**
  * @brief 打印常量定义
  * */
- Result ConstDefAST::print() const {
-    string ident_with_suffix = local_symbol_table->assign(ident);
-
-    Result value_result = value->print();
-    local_symbol_table->create(ident_with_suffix, VAL_(value_result.value));
+ Result ConstDefAST::print(CompilerContext& ctx) const {
+    Result value_result = value->print(ctx);
+    ctx.symbol(binding) = VAL_(value_result.value);
     return Result();
  }
 
 /**
  * @brief 打印常量初始化值
  * */
- Result ConstInitValAST::print() const {
+ Result ConstInitValAST::print(CompilerContext& ctx) const {
     if (const_exp) {
-        return (*const_exp)->print();
+        return const_exp->print(ctx);
     }
     return Result();
 }
@@ -119,20 +94,20 @@ Result BlockAST::print() const {
 /**
  * @brief 打印常量表达式
  * */
-Result ConstExpAST::print() const {
-    return exp->print();
+Result ConstExpAST::print(CompilerContext& ctx) const {
+    return exp->print(ctx);
 }
 
 /**
  * @brief 打印返回语句
  * */
-Result StmtReturnAST::print() const {
+Result StmtReturnAST::print(CompilerContext& ctx) const {
     if (exp) {
-        Result exp_result = (*exp)->print();
-        koopa_ofs << "\tret " << exp_result << endl;
+        Result exp_result = exp->print(ctx);
+        ctx.koopa->_ret(exp_result);
     }
     else {
-        koopa_ofs << "\tret" << endl;
+        ctx.koopa->_ret();
     }
     return Result();
 }
@@ -141,10 +116,8 @@ Result StmtReturnAST::print() const {
  * @brief 打印左值
  * @return 计算结果所在寄存器或立即数
  */
-Result LValAST::print() const {
-    string ident_with_suffix = local_symbol_table->locate(ident);
-    assert(local_symbol_table->exist(ident_with_suffix));
-    auto symbol = local_symbol_table->read(ident_with_suffix);
+Result LValAST::print(CompilerContext& ctx) const {
+    auto& symbol = ctx.symbol(binding);
     if (symbol.type == Symbol::Type::VAL) {
         return IMM_(symbol.value);
     }
@@ -153,492 +126,386 @@ Result LValAST::print() const {
 
 /**
  * @brief 打印表达式
- * */
-Result ExpAST::print() const {
-    return l_or_exp->print();
-}
-
-/**
- * @brief 打印逻辑或表达式
- * */
- Result LOrExpAST::print() const {
-    return l_and_exp->print();
-}
-
-/**
- * @brief 打印逻辑与表达式
- * */
-Result LAndExpAST::print() const {
-    return eq_exp->print();
+ * @return 计算结果所在寄存器或立即数
+ */
+Result ExpAST::print(CompilerContext& ctx) const {
+    return print_node((int32_t)nodes.size() - 1, ctx);
 }
 
 /**
- * @brief 打印逻辑表达式
+ * @brief 打印短路求值的逻辑表达式
+ * @param[in] node 逻辑运算节点
+ * @param[in] lhs 已计算的左表达式结果
+ * @param[in] print_rhs 打印右表达式的函数
  * @return 计算结果所在寄存器或立即数
+ * @note 逻辑或与逻辑与只在短路值与分支顺序上不同
  */
-Result LExpWithOpAST::print() const {
-    // 先打印计算左表达式结果的语句，并获取左表达式结果
-    Result lhs = left->print();
-    // 根据逻辑运算符的类型，打印逻辑运算语句
-    // 逻辑或运算符
-    if (logical_op == LogicalOp::LOGICAL_OR) {
-        // 左侧为立即数
-        if (lhs.type == Result::Type::IMM) {
-            // 如果左侧为立即数，且值不为 0，则直接返回 1，进行短路求值
-            if (lhs.value != 0) {
-                return IMM_(1);
-            }
-            // 如果左侧为立即数，且值为 0，则计算右表达式结果
-            else {
-                Result rhs = right->print();
-                // 如果右表达式结果为立即数，则直接返回右表达式结果
-                if (rhs.type == Result::Type::IMM) {
-                    return IMM_(rhs.value != 0);
-                }
-                else {
-                    // 生成一条 ne 0 指令，相当于 rhs != 0，得到布尔值
-                    koopa_ofs << "\t" << NEW_REG_ << " = ne " << rhs << ", 0" << endl;
-                    return CUR_REG_;
-                }
-            }
+template <typename PrintRhs>
+static Result print_logical(const ExprNode& node, Result lhs, PrintRhs print_rhs, CompilerContext& ctx) {
+    bool is_or = node.op == ExprOp::LOGICAL_OR;
+    // 左侧为立即数
+    if (lhs.type == Result::Type::IMM) {
+        // 左侧的值决定结果时直接返回，进行短路求值：或运算左侧不为 0，与运算左侧为 0
+        if ((lhs.value != 0) == is_or) {
+            return FOLD_(is_or ? 1 : 0);
         }
-        // 左侧不为立即数
-        auto true_label = environment_manager.get_short_true_label();
-        auto false_label = environment_manager.get_short_false_label();
-        auto end_label = environment_manager.get_short_end_label();
-        auto result = environment_manager.get_short_result_reg();
-        environment_manager.add_short_circuit_count();
-
-        // 生成 alloc 指令
-        koopa_ofs << "\t" << result << " = alloc i32" << endl;
-        environment_manager.is_symbol_allocated[result] = true;
-
-        // 生成 br 指令
-        koopa_ofs << "\tbr " << lhs << ", " << true_label << ", " << false_label << endl;
-
-        // 生成 true 分支
-        koopa_ofs << true_label << ":" << endl;
-        koopa_ofs << "\t" << "store 1, " << result << endl;
-        koopa_ofs << "\tjump " << end_label << endl;
-
-        // 生成 false 分支
-        koopa_ofs << false_label << ":" << endl;
-        Result rhs = right->print();
-        Result temp = NEW_REG_;
-        // 生成一条 ne 0 指令，相当于 rhs != 0，得到布尔值
-        koopa_ofs << "\t" << temp << " = ne " << rhs << ", 0" << endl;
-        koopa_ofs << "\t" << "store " << temp << ", " << result << endl;
-        koopa_ofs << "\tjump " << end_label << endl;
-
-        // 生成 end 标签
-        koopa_ofs << end_label << ":" << endl;
-        Result result_reg = NEW_REG_;
-        koopa_ofs << "\t" << result_reg << " = load " << result << endl;
-
-        return result_reg;
-    }
-    // 逻辑与运算符
-    else if (logical_op == LogicalOp::LOGICAL_AND) {
-        // 左侧为立即数
-        if (lhs.type == Result::Type::IMM) {
-            if (lhs.value == 0) {
-                return IMM_(0);
-            }
-            else {
-                Result rhs = right->print();
-                if (rhs.type == Result::Type::IMM) {
-                    return IMM_(rhs.value != 0);
-                }
-                else {
-                    // 生成一条 ne 0 指令，相当于 rhs != 0，得到布尔值
-                    koopa_ofs << "\t" << NEW_REG_ << " = ne " << rhs << ", 0" << endl;
-                    return CUR_REG_;
-                }
-            }
+        // 否则计算右表达式结果
+        Result rhs = print_rhs();
+        // 如果右表达式结果为立即数，则直接返回右表达式结果
+        if (rhs.type == Result::Type::IMM) {
+            return FOLD_(rhs.value != 0);
         }
-        // 左侧不为立即数
-        auto true_label = environment_manager.get_short_true_label();
-        auto false_label = environment_manager.get_short_false_label();
-        auto end_label = environment_manager.get_short_end_label();
-        auto result = environment_manager.get_short_result_reg();
-        environment_manager.add_short_circuit_count();
-
-        // 生成 alloc 指令
-        koopa_ofs << "\t" << result << " = alloc i32" << endl;
-        environment_manager.is_symbol_allocated[result] = true;
-
-        // 生成 br 指令
-        koopa_ofs << "\tbr " << lhs << ", " << true_label << ", " << false_label << endl;
-
-        // 生成 false 分支
-        koopa_ofs << false_label << ":" << endl;
-        koopa_ofs << "\t" << "store 0, " << result << endl;
-        koopa_ofs << "\tjump " << end_label << endl;
-
-        // 生成 true 分支
-        koopa_ofs << true_label << ":" << endl;
-        Result rhs = right->print();
-        Result temp = NEW_REG_;
         // 生成一条 ne 0 指令，相当于 rhs != 0，得到布尔值
-        koopa_ofs << "\t" << temp << " = ne " << rhs << ", 0" << endl;
-        koopa_ofs << "\t" << "store " << temp << ", " << result << endl;
-        koopa_ofs << "\tjump " << end_label << endl;
-
-        // 生成 end 标签
-        koopa_ofs << end_label << ":" << endl;
-        Result result_reg = NEW_REG_;
-        koopa_ofs << "\t" << result_reg << " = load " << result << endl;
-
-        return result_reg;
-    }
-    else {
-        assert(false);
-    }
+        ctx.koopa->_binary(KOOPA_RBO_NOT_EQ, NEW_REG_, rhs, IMM_(0));
+        return CUR_REG_;
+    }
+    // 左侧不为立即数
+    auto true_label = ctx.environment_manager.get_short_true_label();
+    auto false_label = ctx.environment_manager.get_short_false_label();
+    auto end_label = ctx.environment_manager.get_short_end_label();
+    auto result = ctx.environment_manager.get_short_result_reg();
+    ctx.environment_manager.add_short_circuit_count();
+    STAT_(ctx.stats, short_circuits);
+
+    // 生成 alloc 指令
+    ctx.koopa->_alloc(result);
+
+    // 生成 br 指令
+    ctx.koopa->_br(lhs, true_label, false_label);
+
+    // 生成短路分支：或运算为 true 分支存入 1，与运算为 false 分支存入 0
+    ctx.koopa->_label(is_or ? true_label : false_label);
+    ctx.koopa->_store(IMM_(is_or ? 1 : 0), result);
+    ctx.koopa->_jump(end_label);
+
+    // 生成计算右表达式的分支
+    ctx.koopa->_label(is_or ? false_label : true_label);
+    Result rhs = print_rhs();
+    Result temp = NEW_REG_;
+    // 生成一条 ne 0 指令，相当于 rhs != 0，得到布尔值
+    ctx.koopa->_binary(KOOPA_RBO_NOT_EQ, temp, rhs, IMM_(0));
+    ctx.koopa->_store(temp, result);
+    ctx.koopa->_jump(end_label);
+
+    // 生成 end 标签
+    ctx.koopa->_label(end_label);
+    Result result_reg = NEW_REG_;
+    ctx.koopa->_load(result_reg, result);
+
+    return result_reg;
 }
 
 /**
- * @brief 转换等式运算符，输出枚举类型
- * @param[in] op 等式运算符
- * @return 等式运算符枚举类型
+ * @brief 二元运算符对应的 Koopa IR 运算
  */
-EqExpWithOpAST::EqOp EqExpWithOpAST::convert(const string& op) const {
-    if (op == "==") {
-        return EqOp::EQ;
+static koopa_raw_binary_op_t binary_op_of(ExprOp op) {
+    switch (op) {
+    case ExprOp::ADD: return KOOPA_RBO_ADD;
+    case ExprOp::SUB: return KOOPA_RBO_SUB;
+    case ExprOp::MUL: return KOOPA_RBO_MUL;
+    case ExprOp::DIV: return KOOPA_RBO_DIV;
+    case ExprOp::MOD: return KOOPA_RBO_MOD;
+    case ExprOp::LT: return KOOPA_RBO_LT;
+    case ExprOp::GT: return KOOPA_RBO_GT;
+    case ExprOp::LE: return KOOPA_RBO_LE;
+    case ExprOp::GE: return KOOPA_RBO_GE;
+    case ExprOp::EQ: return KOOPA_RBO_EQ;
+    case ExprOp::NEQ: return KOOPA_RBO_NOT_EQ;
+    default: assert(false); return KOOPA_RBO_ADD;
     }
-    else if (op == "!=") {
-        return EqOp::NEQ;
-    }
-    throw runtime_error("Invalid operator: " + op);
 }
 
 /**
- * @brief 打印等式表达式
- * */
-Result EqExpAST::print() const {
-    return rel_exp->print();
+ * @brief 在编译期计算二元运算
+ * @note 除数不能为 0；INT_MIN / -1 按 RISC-V 的 div / rem 结果折叠，不在编译器中溢出
+ */
+static int fold_binary(ExprOp op, int lhs, int rhs) {
+    switch (op) {
+    case ExprOp::ADD: return lhs + rhs;
+    case ExprOp::SUB: return lhs - rhs;
+    case ExprOp::MUL: return lhs * rhs;
+    case ExprOp::DIV: return (lhs == INT32_MIN && rhs == -1) ? lhs : lhs / rhs;
+    case ExprOp::MOD: return (lhs == INT32_MIN && rhs == -1) ? 0 : lhs % rhs;
+    case ExprOp::LT: return lhs < rhs;
+    case ExprOp::GT: return lhs > rhs;
+    case ExprOp::LE: return lhs <= rhs;
+    case ExprOp::GE: return lhs >= rhs;
+    case ExprOp::EQ: return lhs == rhs;
+    case ExprOp::NEQ: return lhs != rhs;
+    default: assert(false); return 0;
+    }
 }
 
 /**
- * @brief 打印带符号的等式表达式
+ * @brief 打印表达式树中的一个节点
+ * @param[in] index 节点下标
  * @return 计算结果所在寄存器或立即数
  */
-Result EqExpWithOpAST::print() const {
-    // 先计算左右表达式结果
-    Result lhs = left->print();
-    Result rhs = right->print();
-    // 若左右表达式结果均为常量，则直接返回常量结果
-    if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM) {
-        switch (eq_op) {
-        case EqOp::EQ:
-            return IMM_(lhs.value == rhs.value);
-        case EqOp::NEQ:
-            return IMM_(lhs.value != rhs.value);
-        default:
-            assert(false);
+Result ExpAST::print_node(int32_t index, CompilerContext& ctx) const {
+    const ExprNode& node = nodes[index];
+    switch (node.op) {
+    case ExprOp::NUMBER:
+        // 数字字面量，即 1
+        return IMM_(node.lhs);
+    case ExprOp::LVAL:
+        // 左值，即 a
+        return l_vals[node.lhs]->print(ctx);
+    case ExprOp::POSITIVE:
+    case ExprOp::NEGATIVE:
+    case ExprOp::NOT: {
+        // 先计算操作数结果
+        Result operand = print_node(node.lhs, ctx);
+        // 若操作数结果为常量，则直接返回常量结果
+        if (operand.type == Result::Type::IMM) {
+            switch (node.op) {
+            case ExprOp::POSITIVE:
+                return FOLD_(operand.value);
+            case ExprOp::NEGATIVE:
+                return FOLD_(-operand.value);
+            default:
+                return FOLD_(!operand.value);
+            }
         }
-    }
-    // 若左右表达式结果不均为常量，则使用临时变量计算结果并存储之
-    else {
+        // 若操作数结果为临时变量，则使用临时变量计算结果并存储之
         Result result = NEW_REG_;
-        switch (eq_op) {
-        case EqOp::EQ:
-            koopa_ofs << "\t" << result << " = eq " << lhs << ", " << rhs << endl;
+        switch (node.op) {
+        case ExprOp::POSITIVE:
+            ctx.koopa->_binary(KOOPA_RBO_ADD, result, IMM_(0), operand);
             break;
-        case EqOp::NEQ:
-            koopa_ofs << "\t" << result << " = ne " << lhs << ", " << rhs << endl;
+        case ExprOp::NEGATIVE:
+            ctx.koopa->_binary(KOOPA_RBO_SUB, result, IMM_(0), operand);
             break;
         default:
-            assert(false);
+            ctx.koopa->_binary(KOOPA_RBO_EQ, result, IMM_(0), operand);
+            break;
+        }
+        return result;
+    }
+    case ExprOp::LOGICAL_AND:
+    case ExprOp::LOGICAL_OR: {
+        // 先打印计算左表达式结果的语句，右表达式按需打印
+        Result lhs = print_node(node.lhs, ctx);
+        return print_logical(node, lhs, [&] { return print_node(node.rhs, ctx); }, ctx);
+    }
+    default: {
+        // 先计算左右表达式结果
+        Result lhs = print_node(node.lhs, ctx);
+        Result rhs = print_node(node.rhs, ctx);
+        // 若左右表达式结果均为常量，则直接返回常量结果
+        if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM) {
+            if ((node.op == ExprOp::DIV || node.op == ExprOp::MOD) && rhs.value == 0) {
+                ctx.error("division by zero in constant expression");
+                return IMM_(0);
+            }
+            return FOLD_(fold_binary(node.op, lhs.value, rhs.value));
         }
+        // 若左右表达式结果不均为常量，则使用临时变量计算结果并存储之
+        Result result = NEW_REG_;
+        ctx.koopa->_binary(binary_op_of(node.op), result, lhs, rhs);
         return result;
     }
+    }
 }
 
+
+// 表达式构建
+
 /**
- * @brief 打印关系表达式
- * */
-Result RelExpAST::print() const {
-    return add_exp->print();
+ * @brief 追加数字字面量节点
+ * @return 节点下标
+ */
+int32_t ExprBuilder::number(int value) {
+    nodes.push_back(ExprNode{ ExprOp::NUMBER, value, 0 });
+    return (int32_t)nodes.size() - 1;
 }
 
 /**
- * @brief 转换关系运算符，输出枚举类型
- * @param[in] op 关系运算符
- * @return 关系运算符枚举类型
+ * @brief 追加左值节点
+ * @return 节点下标
  */
-RelExpWithOpAST::RelOp RelExpWithOpAST::convert(const string& op) const {
-    if (op == "<=") {
-        return RelOp::LE;
-    }
-    else if (op == ">=") {
-        return RelOp::GE;
-    }
-    else if (op == "<") {
-        return RelOp::LT;
-    }
-    else if (op == ">") {
-        return RelOp::GT;
-    }
-    throw runtime_error("Invalid operator: " + op);
+int32_t ExprBuilder::l_val(LValAST* l_val) {
+    l_vals.push_back(l_val);
+    nodes.push_back(ExprNode{ ExprOp::LVAL, (int32_t)l_vals.size() - 1, 0 });
+    return (int32_t)nodes.size() - 1;
 }
 
 /**
- * @brief 打印带符号的关系表达式
- * @return 计算结果所在寄存器或立即数
+ * @brief 追加一元运算节点
+ * @return 节点下标
  */
-Result RelExpWithOpAST::print() const {
-    // 先计算左右表达式结果
-    Result lhs = left->print();
-    Result rhs = right->print();
-    // 若左右表达式结果均为常量，则直接返回常量结果
-    if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM) {
-        switch (rel_op) {
-        case RelOp::LE:
-            return IMM_(lhs.value <= rhs.value);
-        case RelOp::GE:
-            return IMM_(lhs.value >= rhs.value);
-        case RelOp::LT:
-            return IMM_(lhs.value < rhs.value);
-        case RelOp::GT:
-            return IMM_(lhs.value > rhs.value);
-        default:
-            assert(false);
-        }
-    }
-    // 若左右表达式结果不均为常量，则使用临时变量计算结果并存储之
-    else {
-        Result result = NEW_REG_;
-        switch (rel_op) {
-        case RelOp::LE:
-            koopa_ofs << "\t" << result << " = le " << lhs << ", " << rhs << endl;
-            break;
-        case RelOp::GE:
-            koopa_ofs << "\t" << result << " = ge " << lhs << ", " << rhs << endl;
-            break;
-        case RelOp::LT:
-            koopa_ofs << "\t" << result << " = lt " << lhs << ", " << rhs << endl;
-            break;
-        case RelOp::GT:
-            koopa_ofs << "\t" << result << " = gt " << lhs << ", " << rhs << endl;
-            break;
-        default:
-            assert(false);
-        }
-        return result;
-    }
+int32_t ExprBuilder::unary(ExprOp op, int32_t operand) {
+    nodes.push_back(ExprNode{ op, operand, 0 });
+    return (int32_t)nodes.size() - 1;
 }
 
 /**
- * @brief 打印加法表达式
- * */
- Result AddExpAST::print() const {
-    return mul_exp->print();
+ * @brief 追加二元运算节点
+ * @return 节点下标
+ */
+int32_t ExprBuilder::binary(ExprOp op, int32_t lhs, int32_t rhs) {
+    nodes.push_back(ExprNode{ op, lhs, rhs });
+    return (int32_t)nodes.size() - 1;
 }
 
 /**
- * @brief 转换加法运算符，输出枚举类型
- * @param[in] op 加法运算符
- * @return 加法运算符枚举类型
+ * @brief 结束当前表达式，将节点复制到 arena 中
+ * @return 表达式 AST
  */
-AddExpWithOpAST::AddOp AddExpWithOpAST::convert(const string& op) const {
-    if (op == "+") {
-        return AddOp::ADD;
-    }
-    else if (op == "-") {
-        return AddOp::SUB;
+ExpAST* ExprBuilder::finish(Arena& arena) {
+    auto ast = arena.make<ExpAST>();
+    ast->nodes.len = nodes.size();
+    ast->nodes.items = arena.make_array<ExprNode>(nodes.size());
+    copy(nodes.begin(), nodes.end(), ast->nodes.items);
+    ast->l_vals.len = l_vals.size();
+    ast->l_vals.items = arena.make_array<LValAST*>(l_vals.size());
+    copy(l_vals.begin(), l_vals.end(), ast->l_vals.items);
+    nodes.clear();
+    l_vals.clear();
+    return ast;
+}
+
+
+// AST 哈希
+// 每个节点先加入节点类型名，再依次加入各字段和子节点
+
+void ProgramAST::hash(AstHasher& hasher) const {
+    hasher.add("Program");
+    hasher.add((int)comp_units.size());
+    for (auto& comp_unit : comp_units) {
+        comp_unit->hash(hasher);
     }
-    throw runtime_error("Invalid operator: " + op);
 }
 
-/**
- * @brief 打印带符号的加法表达式
- * @return 计算结果所在寄存器或立即数
- */
-Result AddExpWithOpAST::print() const {
-    // 先计算左右表达式结果
-    Result lhs = left->print();
-    Result rhs = right->print();
-    // 若左右表达式结果均为常量，则直接返回常量结果
-    if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM) {
-        switch (add_op) {
-        case AddOp::ADD:
-            return IMM_(lhs.value + rhs.value);
-        case AddOp::SUB:
-            return IMM_(lhs.value - rhs.value);
-        default:
-            assert(false);
-        }
+void FuncDefAST::hash(AstHasher& hasher) const {
+    hasher.add("FuncDef");
+    hasher.add((int)func_type);
+    hasher.add(ident);
+    block->hash(hasher);
+}
+
+void BlockAST::hash(AstHasher& hasher) const {
+    hasher.add("Block");
+    hasher.add((int)block_items.size());
+    for (auto& block_item : block_items) {
+        block_item->hash(hasher);
     }
-    // 若左右表达式结果不均为常量，则使用临时变量计算结果并存储之
-    else {
-        Result result = NEW_REG_;
-        switch (add_op) {
-        case AddOp::ADD:
-            koopa_ofs << "\t" << result << " = add " << lhs << ", " << rhs << endl;
-            break;
-        case AddOp::SUB:
-            koopa_ofs << "\t" << result << " = sub " << lhs << ", " << rhs << endl;
-            break;
-        default:
-            assert(false);
-        }
-        return result;
+}
+
+void ConstDeclAST::hash(AstHasher& hasher) const {
+    hasher.add("ConstDecl");
+    hasher.add((int)const_defs.size());
+    for (auto& item : const_defs) {
+        item->hash(hasher);
     }
 }
 
-/**
- * @brief 打印乘法表达式
- * */
-Result MulExpAST::print() const {
-    return unary_exp->print();
+void ConstDefAST::hash(AstHasher& hasher) const {
+    hasher.add("ConstDef");
+    hasher.add_ident(ident);
+    value->hash(hasher);
 }
 
-/**
- * @brief 转换乘法运算符，输出枚举类型
- * @param[in] op 乘法运算符
- * @return 乘法运算符枚举类型
- */
-MulExpWithOpAST::MulOp MulExpWithOpAST::convert(const string& op) const {
-    if (op == "*") {
-        return MulOp::MUL;
+void ConstInitValAST::hash(AstHasher& hasher) const {
+    hasher.add("ConstInitVal");
+    hasher.add((int)(const_exp != nullptr));
+    if (const_exp) {
+        const_exp->hash(hasher);
     }
-    else if (op == "/") {
-        return MulOp::DIV;
+}
+
+void ConstExpAST::hash(AstHasher& hasher) const {
+    hasher.add("ConstExp");
+    exp->hash(hasher);
+}
+
+void StmtReturnAST::hash(AstHasher& hasher) const {
+    hasher.add("StmtReturn");
+    hasher.add((int)(exp != nullptr));
+    if (exp) {
+        exp->hash(hasher);
     }
-    else if (op == "%") {
-        return MulOp::MOD;
+}
+
+void LValAST::hash(AstHasher& hasher) const {
+    hasher.add("LVal");
+    hasher.add_ident(ident);
+    if (binding.scope == Binding::GLOBAL) {
+        hasher.globals.emplace_back(ident, binding);
     }
-    throw runtime_error("Invalid operator: " + op);
 }
 
-/**
- * @brief 打印带符号的乘法表达式
- * @return 计算结果所在寄存器或立即数
- */
-Result MulExpWithOpAST::print() const {
-    // 先计算左右表达式结果
-    Result lhs = left->print();
-    Result rhs = right->print();
-    // 若左右表达式结果均为常量，则直接返回常量结果
-    if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM) {
-        switch (mul_op) {
-        case MulOp::MUL:
-            return IMM_(lhs.value * rhs.value);
-        case MulOp::DIV:
-            return IMM_(lhs.value / rhs.value);
-        case MulOp::MOD:
-            return IMM_(lhs.value % rhs.value);
-        default:
-            assert(false);
+void ExpAST::hash(AstHasher& hasher) const {
+    hasher.add("Exp");
+    hasher.add((int)nodes.size());
+    for (auto& node : nodes) {
+        hasher.add((int)node.op);
+        if (node.op == ExprOp::LVAL) {
+            l_vals[node.lhs]->hash(hasher);
         }
-    }
-    // 若左右表达式结果不均为常量，则使用临时变量计算结果并存储之
-    else {
-        Result result = NEW_REG_;
-        switch (mul_op) {
-        case MulOp::MUL:
-            koopa_ofs << "\t" << result << " = mul " << lhs << ", " << rhs << endl;
-            break;
-        case MulOp::DIV:
-            koopa_ofs << "\t" << result << " = div " << lhs << ", " << rhs << endl;
-            break;
-        case MulOp::MOD:
-            koopa_ofs << "\t" << result << " = mod " << lhs << ", " << rhs << endl;
-            break;
-        default:
-            assert(false);
+        else {
+            hasher.add(node.lhs);
+            hasher.add(node.rhs);
         }
-        return result;
     }
 }
 
-/**
- * @brief 打印一元表达式
- * */
-Result UnaryExpAST::print() const {
-    return primary_exp->print();
-}
 
-/**
- * @brief 转换一元运算符，输出枚举类型
- * @param[in] op 一元运算符
- * @return 一元运算符枚举类型
- */
-UnaryExpWithOpAST::UnaryOp UnaryExpWithOpAST::convert(const string& op) const {
-    
-    if (op == "+") {
-        return UnaryOp::POSITIVE;
-    }
-    else if (op == "-") {
-        return UnaryOp::NEGATIVE;
+// 名字解析
+// 每个 Block 是一层作用域，常量在初始化值解析之后才可见
+
+void ProgramAST::bind(Binder& binder) {
+    for (auto& comp_unit : comp_units) {
+        comp_unit->bind(binder);
     }
-    else if (op == "!") {
-        return UnaryOp::NOT;
+}
+
+void FuncDefAST::bind(Binder& binder) {
+    binder.enter_function();
+    block->bind(binder);
+    slots = binder.exit_function();
+}
+
+void BlockAST::bind(Binder& binder) {
+    binder.enter_scope();
+    for (auto& block_item : block_items) {
+        block_item->bind(binder);
     }
-    throw runtime_error("Invalid operator: " + op);
+    binder.exit_scope();
 }
 
-/**
- * @brief 打印带符号的一元表达式
- * @return 计算结果所在寄存器或立即数
- */
- Result UnaryExpWithOpAST::print() const {
-    
-    // 先计算表达式结果
-    Result unary_exp_result = unary_exp->print();
-    // 若表达式结果为常量，则直接返回常量结果
-    if (unary_exp_result.type == Result::Type::IMM) {
-        switch (unary_op) {
-        case UnaryOp::POSITIVE:
-            return IMM_(unary_exp_result.value);
-        case UnaryOp::NEGATIVE:
-            return IMM_(-unary_exp_result.value);
-        case UnaryOp::NOT:
-            return IMM_(!unary_exp_result.value);
-        default:
-            assert(false);
-        }
+void ConstDeclAST::bind(Binder& binder) {
+    for (auto& item : const_defs) {
+        item->bind(binder);
     }
-    // 若表达式结果为临时变量，则使用临时变量计算结果并存储之
-    else {
-        Result result = NEW_REG_;
-        switch (unary_op) {
-        case UnaryOp::POSITIVE:
-            koopa_ofs << "\t" << result << " = add 0, " << unary_exp_result << endl;
-            break;
-        case UnaryOp::NEGATIVE:
-            koopa_ofs << "\t" << result << " = sub 0, " << unary_exp_result << endl;
-            break;
-        case UnaryOp::NOT:
-            koopa_ofs << "\t" << result << " = eq 0, " << unary_exp_result << endl;
-            break;
-        default:
-            assert(false);
-        }
-        return result;
+}
+
+void ConstDefAST::bind(Binder& binder) {
+    value->bind(binder);
+    binding = binder.define(ident);
+}
+
+void ConstInitValAST::bind(Binder& binder) {
+    if (const_exp) {
+        const_exp->bind(binder);
     }
 }
 
-/**
-* @brief 打印括号优先表达式，即 (a)
-* @return 计算结果所在寄存器或立即数
-*/
-Result PrimaryExpAST::print() const {
-    return exp->print();
+void ConstExpAST::bind(Binder& binder) {
+    exp->bind(binder);
 }
 
-/**
- * @brief 打印数字优先表达式，即 1
- * @return 立即数
- */
-Result PrimaryExpWithNumberAST::print() const {
-    return IMM_(number);
+void StmtReturnAST::bind(Binder& binder) {
+    if (exp) {
+        exp->bind(binder);
+    }
 }
 
-/**
- * @brief 打印左值优先表达式，即 a
- * @return 左值结果所在寄存器
- */
- Result PrimaryExpWithLValAST::print() const {
-    return l_val->print();
-}
\ No newline at end of file
+void LValAST::bind(Binder& binder) {
+    binding = binder.resolve(ident);
+}
+
+void ExpAST::bind(Binder& binder) {
+    for (auto l_val : l_vals) {
+        l_val->bind(binder);
+    }
+}
@@ -1,44 +1,89 @@
 #include "include/backend_utils.hpp"
 
 /**
- * @brief 解析 KoopaIR 字符串，生成 Riscv 汇编代码
+ * @brief 解析 KoopaIR 字符串，构建 raw program
  * @param[in] koopa_ir KoopaIR 字符串
+ * @param[out] builder raw program builder，raw program 使用完毕后由调用者释放
+ * @param[out] raw raw program
+ * @param[in] timer 计时报告，可以为空
+ * @return 是否解析成功，失败时不需要释放 builder
  */
- void parse_riscv(const char* koopa_ir) {
+bool parse_raw(const char* koopa_ir, koopa_raw_program_builder_t& builder, koopa_raw_program_t& raw, TimeReport* timer) {
     // 解析字符串 str, 得到 Koopa IR 程序
     koopa_program_t program;
-    koopa_error_code_t ret = koopa_parse_from_string(koopa_ir, &program);
-    // 确保解析时没有出错
-    assert(ret == KOOPA_EC_SUCCESS);
+    {
+        TimeScope scope(timer, "koopa-parse");
+        koopa_error_code_t ret = koopa_parse_from_string(koopa_ir, &program);
+        // 输入可能来自用户提供的 .koopa 文件, 解析出错时返回失败
+        if (ret != KOOPA_EC_SUCCESS) {
+            return false;
+        }
+    }
     // 创建一个 raw program builder, 用来构建 raw program
-    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
-    // 将 Koopa IR 程序转换为 raw program
-    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-    // 释放 Koopa IR 程序占用的内存
-    koopa_delete_program(program);
+    builder = koopa_new_raw_program_builder();
+    {
+        TimeScope scope(timer, "raw-build");
+        // 将 Koopa IR 程序转换为 raw program
+        raw = koopa_build_raw_program(builder, program);
+        // 释放 Koopa IR 程序占用的内存
+        koopa_delete_program(program);
+    }
+    return true;
+}
 
-    // 处理 raw program
-    visit(raw);
+/**
+ * @brief 取 Koopa IR 指令种类的名字
+ * @param[in] tag 指令种类
+ * @return 名字，与 Koopa IR 文本中的写法一致
+ */
+const char* value_kind_name(koopa_raw_value_tag_t tag) {
+    // 下标为 koopa_raw_value_tag_t
+    static const char* names[] = {
+        "integer", "zeroinit", "undef", "aggregate", "func_arg_ref", "block_arg_ref",
+        "alloc", "global_alloc", "load", "store", "getptr", "getelemptr",
+        "binary", "br", "jump", "call", "ret",
+    };
+    return (size_t)tag < sizeof(names) / sizeof(names[0]) ? names[tag] : "unknown";
+}
 
-    // 处理完成, 释放 raw program builder 占用的内存
-    // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
-    // 所以不要在 raw program 处理完毕之前释放 builder
-    koopa_delete_raw_program_builder(builder);
+/**
+ * @brief 将缓冲区交给后台写出线程
+ * @param[in] force 为 false 时仅在缓冲区超过 flush_threshold 时写出，为 true 时总是写出
+ * @note 在每个函数生成完毕后调用，小函数的输出会累积在同一个缓冲区中
+ */
+void Riscv::flush(bool force) {
+    if (writer == nullptr) {
+        return;
+    }
+    if (force || buffer.size() >= flush_threshold) {
+        writer->submit(move(buffer.buffer));
+        buffer.buffer.reserve(flush_threshold);
+    }
 }
 
 // 特殊语句 
+/**
+ * @brief 生成空行，用于分隔函数
+ */
+void Riscv::_blank() {
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << '\n';
+}
+
 /**
  * @brief 生成 .data 宏
  */
  void Riscv::_data() {
-    riscv_ofs << "\t.data" << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.data" << '\n';
 }
 
 /**
  * @brief 生成 .text 宏
  */
 void Riscv::_text() {
-    riscv_ofs << "\t.text" << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.text" << '\n';
 }
 
 /**
@@ -46,7 +91,8 @@ void Riscv::_text() {
  * @param[in] name 全局变量名
  */
 void Riscv::_globl(const string& name) {
-    riscv_ofs << "\t.globl " << name << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.globl " << name << '\n';
 }
 
 /**
@@ -54,7 +100,8 @@ void Riscv::_globl(const string& name) {
  * @param[in] value 要存储的值
  */
 void Riscv::_word(const int& value) {
-    riscv_ofs << "\t.word " << value << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.word " << value << '\n';
 }
 
 /**
@@ -62,7 +109,8 @@ void Riscv::_word(const int& value) {
  * @param[in] len 要填充的 0 的个数
  */
 void Riscv::_zero(const int& len) {
-    riscv_ofs << "\t.zero " << len << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.zero " << len << '\n';
 }
 
 /**
@@ -70,7 +118,26 @@ void Riscv::_zero(const int& len) {
  * @param[in] name 标签名
  */
 void Riscv::_label(const string& name) {
-    riscv_ofs << name << ":" << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << name << ":" << '\n';
+}
+
+/**
+ * @brief 生成 .asciz "str" 宏，即以 '\0' 结尾的字符串
+ * @param[in] str 字符串，不能包含需要转义的字符
+ */
+void Riscv::_asciz(const string& str) {
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.asciz \"" << str << "\"" << '\n';
+}
+
+/**
+ * @brief 生成 .align exp 宏，即按 2^exp 字节对齐
+ * @param[in] exp 对齐的指数
+ */
+void Riscv::_align(const int& exp) {
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\t.align " << exp << '\n';
 }
 
 
@@ -81,7 +148,8 @@ void Riscv::_label(const string& name) {
  * @param[in] rs1 源寄存器
  */
  void Riscv::_seqz(const string& rd, const string& rs1) {
-    riscv_ofs << "\tseqz " << rd << ", " << rs1 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tseqz " << rd << ", " << rs1 << '\n';
 }
 
 /**
@@ -90,7 +158,8 @@ void Riscv::_label(const string& name) {
  * @param[in] rs1 源寄存器
  */
 void Riscv::_snez(const string& rd, const string& rs1) {
-    riscv_ofs << "\tsnez " << rd << ", " << rs1 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tsnez " << rd << ", " << rs1 << '\n';
 }
 
 /**
@@ -99,7 +168,8 @@ void Riscv::_snez(const string& rd, const string& rs1) {
  * @param[in] imm 立即数
  */
  void Riscv::_li(const string& rd, const int& imm) {
-    riscv_ofs << "\tli " << rd << ", " << imm << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tli " << rd << ", " << imm << '\n';
 }
 
 /**
@@ -108,7 +178,8 @@ void Riscv::_snez(const string& rd, const string& rs1) {
  * @param[in] rs1 源寄存器
  */
 void Riscv::_mv(const string& rd, const string& rs1) {
-    riscv_ofs << "\tmv " << rd << ", " << rs1 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tmv " << rd << ", " << rs1 << '\n';
 }
 
 /**
@@ -117,7 +188,8 @@ void Riscv::_mv(const string& rd, const string& rs1) {
  * @param[in] rs1 源寄存器
  */
 void Riscv::_la(const string& rd, const string& rs1) {
-    riscv_ofs << "\tla " << rd << ", " << rs1 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tla " << rd << ", " << rs1 << '\n';
 }
 
 // 双目运算
@@ -128,7 +200,8 @@ void Riscv::_la(const string& rd, const string& rs1) {
  * @param[in] rs2 源寄存器 2
  */
  void Riscv::_or(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tor " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tor " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -138,7 +211,8 @@ void Riscv::_la(const string& rd, const string& rs1) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_and(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tand " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tand " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -148,7 +222,8 @@ void Riscv::_and(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_xor(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\txor " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\txor " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -158,7 +233,8 @@ void Riscv::_xor(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_add(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tadd " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tadd " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -166,11 +242,16 @@ void Riscv::_add(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rd 目标寄存器
  * @param[in] rs1 源寄存器
  * @param[in] imm 立即数
- * @note 如果 imm 超过 12 位立即数限制，则会先将其存入一个临时寄存器，再进行加法运算
+ * @note 如果 imm 超过 12 位立即数限制，则会先将其存入临时寄存器 scratch，再用 add 进行加法运算
  */
 void Riscv::_addi(const string& rd, const string& rs1, const int& imm) {
     if (imm >= -2048 && imm < 2048) {
-        riscv_ofs << "\taddi " << rd << ", " << rs1 << ", " << imm << endl;
+        STAT_(stats, riscv_insts[__func__]);
+        buffer << "\taddi " << rd << ", " << rs1 << ", " << imm << '\n';
+    }
+    else {
+        _li(scratch, imm);
+        _add(rd, rs1, scratch);
     }
 }
 
@@ -181,7 +262,8 @@ void Riscv::_addi(const string& rd, const string& rs1, const int& imm) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_sub(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tsub " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tsub " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -191,7 +273,8 @@ void Riscv::_sub(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_mul(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tmul " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tmul " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -201,7 +284,8 @@ void Riscv::_mul(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_div(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tdiv " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tdiv " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -211,7 +295,8 @@ void Riscv::_div(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_rem(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\trem " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\trem " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -221,7 +306,8 @@ void Riscv::_rem(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_sgt(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tsgt " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tsgt " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -231,7 +317,8 @@ void Riscv::_sgt(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_slt(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tslt " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tslt " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 /**
@@ -241,7 +328,8 @@ void Riscv::_slt(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs2 源寄存器 2
  */
 void Riscv::_sll(const string& rd, const string& rs1, const string& rs2) {
-    riscv_ofs << "\tsll " << rd << ", " << rs1 << ", " << rs2 << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tsll " << rd << ", " << rs1 << ", " << rs2 << '\n';
 }
 
 
@@ -251,12 +339,36 @@ void Riscv::_sll(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rd 目标寄存器
  * @param[in] base 基址寄存器
  * @param[in] bias 偏移量
- * @note 会自动处理偏移量，若偏移量超过 12 位立即数限制，则先将其存入一个临时寄存器，再进行加法运算
+ * @note 会自动处理偏移量，若偏移量超过 12 位立即数限制，则先将地址算到临时寄存器 scratch 中
  */
  void Riscv::_lw(const string& rd, const string& base, const int& bias) {
     // 检查偏移量是否在 12 位立即数范围内
     if (bias >= -2048 && bias < 2048) {
-        riscv_ofs << "\tlw " << rd << ", " << bias << "(" << base << ")" << endl;
+        STAT_(stats, riscv_insts[__func__]);
+        buffer << "\tlw " << rd << ", " << bias << "(" << base << ")" << '\n';
+    }
+    else {
+        _addi(scratch, base, bias);
+        _lw(rd, scratch, 0);
+    }
+}
+
+/**
+ * @brief 生成 lbu（加载无符号字节）指令，即 rd = *(uint8_t*)(base + bias)
+ * @param[in] rd 目标寄存器
+ * @param[in] base 基址寄存器
+ * @param[in] bias 偏移量
+ * @note 与 _lw 相同，偏移量超过 12 位立即数限制时先将地址算到临时寄存器 scratch 中
+ */
+void Riscv::_lbu(const string& rd, const string& base, const int& bias) {
+    // 检查偏移量是否在 12 位立即数范围内
+    if (bias >= -2048 && bias < 2048) {
+        STAT_(stats, riscv_insts[__func__]);
+        buffer << "\tlbu " << rd << ", " << bias << "(" << base << ")" << '\n';
+    }
+    else {
+        _addi(scratch, base, bias);
+        _lbu(rd, scratch, 0);
     }
 }
 
@@ -265,12 +377,17 @@ void Riscv::_sll(const string& rd, const string& rs1, const string& rs2) {
  * @param[in] rs 源寄存器
  * @param[in] base 基址寄存器
  * @param[in] bias 偏移量
- * @note 会自动处理偏移量，若偏移量超过 12 位立即数限制，则先将其存入一个临时寄存器，再进行加法运算
+ * @note 会自动处理偏移量，若偏移量超过 12 位立即数限制，则先将地址算到临时寄存器 scratch 中
  */
 void Riscv::_sw(const string& rs, const string& base, const int& bias) {
     // 检查偏移量是否在 12 位立即数范围内
     if (bias >= -2048 && bias < 2048) {
-        riscv_ofs << "\tsw " << rs << ", " << bias << "(" << base << ")" << endl;
+        STAT_(stats, riscv_insts[__func__]);
+        buffer << "\tsw " << rs << ", " << bias << "(" << base << ")" << '\n';
+    }
+    else {
+        _addi(scratch, base, bias);
+        _sw(rs, scratch, 0);
     }
 }
 
@@ -282,7 +399,8 @@ void Riscv::_sw(const string& rs, const string& base, const int& bias) {
  * @param[in] label 跳转目标标签
  */
  void Riscv::_jump(const string& label) {
-    riscv_ofs << "\tj " << label << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tj " << label << '\n';
 }
 
 
@@ -293,6 +411,7 @@ void Riscv::_sw(const string& rs, const string& base, const int& bias) {
  * @note 会生成多个标签，将短跳转转为长跳转，避免跳转范围限制
  */
  void Riscv::_bnez(const string& cond, const string& label) {
+    STAT_(stats, riscv_insts[__func__]);
     // auto target_1 = context_manager.get_branch_label();
     // auto target_2 = context_manager.get_branch_end_label();
     // riscv_ofs << "\tbnez " << cond << ", " << target_1 << endl;
@@ -300,7 +419,7 @@ void Riscv::_sw(const string& rs, const string& base, const int& bias) {
     // _label(target_1);
     // _jump(label);
     // _label(target_2);
-    riscv_ofs << "\tbnez " << cond << ", " << label << endl;
+    buffer << "\tbnez " << cond << ", " << label << '\n';
 }
 
 /**
@@ -310,6 +429,7 @@ void Riscv::_sw(const string& rs, const string& base, const int& bias) {
  * @note 会生成多个标签，将短跳转转为长跳转，避免跳转范围限制
  */
 void Riscv::_beqz(const string& cond, const string& label) {
+    STAT_(stats, riscv_insts[__func__]);
     // auto target_1 = context_manager.get_branch_label();
     // auto target_2 = context_manager.get_branch_end_label();
     // riscv_ofs << "\tbeqz " << cond << ", " << target_1 << endl;
@@ -317,7 +437,26 @@ void Riscv::_beqz(const string& cond, const string& label) {
     // _label(target_1);
     // _jump(label);
     // _label(target_2);
-    riscv_ofs << "\tbeqz " << cond << ", " << label << endl;
+    buffer << "\tbeqz " << cond << ", " << label << '\n';
+}
+
+// 性能计数器
+/**
+ * @brief 生成 rdcycle 指令，即 rd = 周期计数器的低 32 位
+ * @param[in] rd 目标寄存器
+ */
+void Riscv::_rdcycle(const string& rd) {
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\trdcycle " << rd << '\n';
+}
+
+/**
+ * @brief 生成 rdinstret 指令，即 rd = 已退休指令计数器的低 32 位
+ * @param[in] rd 目标寄存器
+ */
+void Riscv::_rdinstret(const string& rd) {
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\trdinstret " << rd << '\n';
 }
 
 // 调用与返回
@@ -326,13 +465,15 @@ void Riscv::_beqz(const string& cond, const string& label) {
  * @param[in] ident 函数名
  */
 void Riscv::_call(const string& ident) {
-    riscv_ofs << "\tcall " << ident << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tcall " << ident << '\n';
 }
 
 /**
  * @brief 生成 ret 指令
  */
 void Riscv::_ret() {
-    riscv_ofs << "\tret" << endl;
+    STAT_(stats, riscv_insts[__func__]);
+    buffer << "\tret" << '\n';
 }
 
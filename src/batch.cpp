@@ -0,0 +1,222 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "include/batch.hpp"
+#include "include/context.hpp"
+
+/**
+ * @brief 单个任务的编译结果
+ */
+struct BatchResult {
+    bool ok = false;
+    size_t bytes = 0;
+    size_t lines = 0;
+    double ms = 0;
+    // 该任务的诊断信息，随任务结果一起报告
+    string diagnostics;
+};
+
+/**
+ * @brief 判断是否为批量模式支持的编译模式
+ */
+static bool valid_mode(const string& mode) {
+    return mode == "-koopa" || mode == "-riscv";
+}
+
+/**
+ * @brief 打印批量模式的用法
+ */
+static void batch_usage() {
+    cerr << "usage: compiler -batch <mode> [-j threads] [-f manifest] [input output]..." << endl;
+    cerr << "  manifest: one job per line, `[mode] input output`, '#' starts a comment" << endl;
+}
+
+/**
+ * @brief 解析线程数
+ * @param[in] text 命令行参数
+ * @param[out] threads 线程数
+ * @return 是否为正整数
+ */
+static bool parse_threads(const char* text, size_t& threads) {
+    char* end;
+    errno = 0;
+    auto value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || value <= 0) {
+        return false;
+    }
+    threads = value;
+    return true;
+}
+
+/**
+ * @brief 读取清单文件，每行一个任务
+ * @param[in] path 清单文件路径
+ * @param[in] mode 行内未指定模式时使用的模式
+ * @param[out] jobs 任务列表
+ * @return 是否读取成功
+ */
+static bool read_manifest(const char* path, const string& mode, vector<BatchJob>& jobs) {
+    ifstream ifs(path);
+    if (!ifs) {
+        cerr << "error: cannot open manifest " << path << endl;
+        return false;
+    }
+    string line;
+    int line_no = 0;
+    while (getline(ifs, line)) {
+        line_no++;
+        auto comment = line.find('#');
+        if (comment != string::npos) {
+            line.erase(comment);
+        }
+        istringstream iss(line);
+        vector<string> fields;
+        string field;
+        while (iss >> field) {
+            fields.push_back(field);
+        }
+        if (fields.empty()) {
+            continue;
+        }
+        if (fields.size() == 2) {
+            jobs.push_back({ mode, fields[0], fields[1] });
+        }
+        else if (fields.size() == 3 && fields[0][0] == '-') {
+            jobs.push_back({ fields[0], fields[1], fields[2] });
+        }
+        else {
+            cerr << "error: " << path << ":" << line_no << ": expected `[mode] input output`" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 统计源文件行数
+ */
+static size_t count_lines(const MappedFile& source) {
+    size_t lines = 0;
+    const char* data = source.data();
+    const char* end = data + source.size();
+    while (data < end && (data = static_cast<const char*>(memchr(data, '\n', end - data))) != nullptr) {
+        lines++;
+        data++;
+    }
+    return lines;
+}
+
+/**
+ * @brief 批量模式入口，在一个进程中用线程池编译多个源文件
+ * @note 用法：compiler -batch 模式 [-j 线程数] [-f 清单文件] [输入文件 输出文件]...
+ * @note 每个任务使用独立的 CompilerContext，结果与诊断信息按任务顺序报告到 stderr，
+ * @note 一个任务失败不影响其他任务
+ * @return 全部成功返回 0，否则返回 1；没有任务或模式无效时返回 1
+ */
+int run_batch(int argc, const char* argv[]) {
+    if (argc < 3) {
+        batch_usage();
+        return 1;
+    }
+    string mode = argv[2];
+    size_t threads = thread::hardware_concurrency();
+    vector<BatchJob> jobs;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            if (!parse_threads(argv[++i], threads)) {
+                cerr << "error: invalid thread count " << argv[i] << endl;
+                batch_usage();
+                return 1;
+            }
+        }
+        else if (arg == "-mem-report" || arg == "-mem-report-json") {
+            // 堆内存统计是进程级的，无法区分同时进行的各个任务
+            cerr << "error: " << arg << " is not supported in batch mode" << endl;
+            return 1;
+        }
+        else if (arg == "-f" && i + 1 < argc) {
+            if (!read_manifest(argv[++i], mode, jobs)) {
+                return 1;
+            }
+        }
+        else if (i + 1 < argc) {
+            jobs.push_back({ mode, arg, argv[++i] });
+        }
+        else {
+            batch_usage();
+            return 1;
+        }
+    }
+
+    if (jobs.empty()) {
+        cerr << "error: no input files" << endl;
+        batch_usage();
+        return 1;
+    }
+    for (auto& job : jobs) {
+        if (!valid_mode(job.mode)) {
+            cerr << "error: unknown mode " << job.mode << " for " << job.input << endl;
+            batch_usage();
+            return 1;
+        }
+    }
+
+    vector<BatchResult> results(jobs.size());
+    auto start = chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool.submit([&jobs, &results, i] {
+                auto job_start = chrono::steady_clock::now();
+                CompilerContext ctx;
+                auto& result = results[i];
+                ctx.diagnostics = &result.diagnostics;
+                try {
+                    result.ok = ctx.compile(jobs[i].mode, jobs[i].input.c_str(), jobs[i].output.c_str());
+                }
+                catch (const exception& e) {
+                    // 一个任务的失败不能终止其他任务
+                    result.ok = false;
+                    result.diagnostics += string("error: internal compiler error: ") + e.what() + "\n";
+                }
+                result.bytes = ctx.source.size();
+                result.lines = count_lines(ctx.source);
+                auto job_end = chrono::steady_clock::now();
+                result.ms = chrono::duration<double, milli>(job_end - job_start).count();
+            });
+        }
+        pool.wait();
+    }
+    auto end = chrono::steady_clock::now();
+    double wall_ms = chrono::duration<double, milli>(end - start).count();
+
+    // 逐个报告任务结果
+    size_t failed = 0, total_bytes = 0, total_lines = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        auto& result = results[i];
+        fprintf(stderr, "%s %s -> %s: %zu lines, %.3f ms, %.0f lines/s\n",
+                result.ok ? "ok  " : "FAIL", jobs[i].input.c_str(), jobs[i].output.c_str(),
+                result.lines, result.ms, result.ms > 0 ? result.lines * 1000.0 / result.ms : 0.0);
+        fputs(result.diagnostics.c_str(), stderr);
+        failed += !result.ok;
+        total_bytes += result.bytes;
+        total_lines += result.lines;
+    }
+
+    // 汇总
+    double seconds = wall_ms / 1000.0;
+    fprintf(stderr, "batch: %zu files (%zu failed) on %zu threads in %.3f ms\n",
+            jobs.size(), failed, threads == 0 ? 1 : threads, wall_ms);
+    if (seconds > 0) {
+        fprintf(stderr, "batch: %.1f files/s, %.0f lines/s, %.2f MB/s\n",
+                jobs.size() / seconds, total_lines / seconds, total_bytes / seconds / (1 << 20));
+    }
+    return failed == 0 ? 0 : 1;
+}
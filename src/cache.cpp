@@ -0,0 +1,62 @@
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "include/cache.hpp"
+
+/**
+ * @brief 打开缓存目录，不存在则创建
+ * @param[in] dir 缓存目录
+ * @return 是否成功
+ */
+bool CompileCache::open(const string& dir) {
+    this->dir = dir;
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief 读取缓存
+ * @param[in] key 键
+ * @param[in] ext 扩展名，区分不同模式的输出
+ * @param[out] content 缓存的内容
+ * @return 是否命中
+ */
+bool CompileCache::load(const string& key, const string& ext, string& content) {
+    ifstream ifs(dir + "/" + key + ext, ios::binary);
+    if (!ifs) {
+        misses++;
+        return false;
+    }
+    ostringstream oss;
+    oss << ifs.rdbuf();
+    content = oss.str();
+    hits++;
+    return true;
+}
+
+/**
+ * @brief 写入缓存，写入失败时忽略
+ * @param[in] key 键
+ * @param[in] ext 扩展名，区分不同模式的输出
+ * @param[in] content 要缓存的内容
+ */
+void CompileCache::store(const string& key, const string& ext, const string& content) {
+    string path = dir + "/" + key + ext;
+    string temp = path + ".tmp." + to_string(getpid()) + "." + to_string(hash<thread::id>()(this_thread::get_id()));
+    {
+        ofstream ofs(temp, ios::binary);
+        if (!ofs.write(content.data(), content.size())) {
+            unlink(temp.c_str());
+            return;
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+    }
+}
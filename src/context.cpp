@@ -0,0 +1,510 @@
+#include "include/context.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "include/interp.hpp"
+#include "sysy.tab.hpp"
+
+// 可重入 lexer 的接口, 由 flex 生成
+struct yy_buffer_state;
+int yylex_init_extra(CompilerContext *extra, yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+void yy_delete_buffer(yy_buffer_state *buffer, yyscan_t scanner);
+
+/**
+ * @brief 解析已载入的源文件，得到 AST
+ * @return 是否解析成功
+ * @note lexer 直接在映射上扫描，token 和 AST 中的标识符指向映射中的字符，并在 interner 中驻留
+ */
+bool CompilerContext::parse() {
+    yyscan_t scanner;
+    if (yylex_init_extra(this, &scanner) != 0) {
+        return false;
+    }
+    auto buffer = yy_scan_buffer(source.data(), source.scan_size(), scanner);
+    assert(buffer);
+    TimeScope scope(timer, "parse");
+    MemoryScope memory_scope(memory, "parse");
+    auto ret = yyparse(scanner, *this);
+    yy_delete_buffer(buffer, scanner);
+    yylex_destroy(scanner);
+    return ret == 0;
+}
+
+/**
+ * @brief 对解析得到的 AST 做名字解析
+ * @param[in] ast 整个程序或流水线模式下的一个函数
+ * @return 使用的名字是否都有定义，有未定义的名字时不能生成 IR
+ * @note 全局的绑定在多次调用之间保留，流水线模式下按源顺序逐个函数调用
+ * @note 未定义的名字由 report_undefined() 报告，流水线模式下要等 parser 线程结束后才能读取 interner
+ */
+bool CompilerContext::bind(BaseAST* ast) {
+    TimeScope scope(timer, "bind");
+    MemoryScope memory_scope(memory, "bind");
+    size_t undefined = binder.undefined.size();
+    ast->bind(binder);
+    return binder.undefined.size() == undefined;
+}
+
+/**
+ * @brief 报告名字解析中遇到的未定义的名字
+ */
+void CompilerContext::report_undefined() {
+    for (auto ident : binder.undefined) {
+        error("undefined identifier '" + string(interner.name(ident)) + "'");
+    }
+    binder.undefined.clear();
+}
+
+/**
+ * @brief 报告一条编译错误，并记入错误数
+ * @param[in] message 错误信息，不含 "error: " 前缀
+ * @note 流水线模式下 parser 线程与 IR 线程都可能报告错误
+ */
+void CompilerContext::error(const string& message) {
+    lock_guard<mutex> lock(error_mutex);
+    errors++;
+    if (diagnostics != nullptr) {
+        diagnostics->append("error: " + message + "\n");
+    }
+    else {
+        cerr << "error: " << message << endl;
+    }
+}
+
+/**
+ * @brief 打开输出文件，失败时报告错误
+ * @param[in] output 输出文件路径
+ * @param[in] background 是否使用后台线程写出
+ * @return 是否打开成功
+ */
+bool CompilerContext::open_output(const char* output, bool background) {
+    if (!writer.open(output, background)) {
+        error("cannot open " + string(output) + ": " + strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 写出剩余内容并关闭输出文件，失败时报告错误
+ * @param[in] output 输出文件路径
+ * @param[in] ok 编译是否成功，失败时删除已经写出的部分输出
+ * @return 编译成功且输出完整写出
+ * @note 只删除普通文件，不删除 /dev/null 等设备文件
+ */
+bool CompilerContext::close_output(const char* output, bool ok) {
+    if (int err = writer.close()) {
+        error("cannot write " + string(output) + ": " + strerror(err));
+        ok = false;
+    }
+    struct stat st;
+    if (!ok && stat(output, &st) == 0 && S_ISREG(st.st_mode)) {
+        unlink(output);
+    }
+    return ok;
+}
+
+/**
+ * @brief 编译一个源文件
+ * @param[in] mode 编译模式，-koopa 输出 Koopa IR，-riscv 输出 RISC-V 汇编
+ * @param[in] input 源文件路径，以 .koopa 结尾时作为 Koopa IR 文本输入，只运行后端
+ * @param[in] output 输出文件路径
+ * @return 是否编译成功
+ */
+bool CompilerContext::compile(const string& mode, const char* input, const char* output) {
+    if (!source.open(input)) {
+        error("cannot open " + string(input) + ": " + strerror(errno));
+        return false;
+    }
+    string_view path(input);
+    if (path.size() >= 6 && path.substr(path.size() - 6) == ".koopa") {
+        return compile_koopa(mode, output);
+    }
+    return compile_source(mode, output);
+}
+
+/**
+ * @brief 编译已载入 source 的 Koopa IR 文本，跳过前端
+ * @param[in] mode 编译模式，支持 -riscv 与 -interp
+ * @param[in] output 输出文件路径
+ * @return 是否编译成功
+ * @note 用 libkoopa 解析文本并构建 raw program，再由 visit() 生成汇编，
+ * @note 可以在不经过前端的情况下测试后端
+ * @note -riscv 模式下后端只支持 ret 与 ret 整数常量，含有其他指令或全局变量的程序报告 unsupported Koopa instruction
+ */
+bool CompilerContext::compile_koopa(const string& mode, const char* output) {
+    this->mode = mode;
+    if (mode == "-interp") {
+        koopa_raw_program_builder_t builder;
+        koopa_raw_program_t raw;
+        if (!parse_raw(source.data(), builder, raw, timer)) {
+            error("invalid Koopa IR");
+            return false;
+        }
+        auto ok = interpret(raw, output);
+        koopa_delete_raw_program_builder(builder);
+        return ok;
+    }
+    if (mode != "-riscv") {
+        error("Koopa IR input requires -riscv or -interp");
+        return false;
+    }
+    if (!open_output(output)) {
+        return false;
+    }
+    writer.timer = timer;
+    riscv.timer = timer;
+    riscv.stats = stats;
+
+    unique_ptr<ThreadPool> pool;
+    if (threads > 1) {
+        pool = make_unique<ThreadPool>(threads);
+    }
+    riscv.writer = &writer;
+    riscv.pool = pool.get();
+    bool ok;
+    {
+        MemoryScope memory_scope(memory, "backend");
+        koopa_raw_program_builder_t builder;
+        koopa_raw_program_t raw;
+        // 映射末尾有 '\0'，可以直接作为 C 字符串解析
+        ok = parse_raw(source.data(), builder, raw, timer);
+        if (!ok) {
+            error("invalid Koopa IR");
+        }
+        else {
+            // 输入可能是任意的 .koopa 文件，生成汇编前排除后端不支持的指令
+            string unsupported;
+            ok = check_supported(raw, unsupported);
+            if (!ok) {
+                error("unsupported Koopa instruction " + unsupported);
+            }
+            else {
+                TimeScope scope(timer, "codegen");
+                visit(raw, riscv);
+            }
+            // raw program 中的指针都指向 builder 的内存，用完后才能释放
+            koopa_delete_raw_program_builder(builder);
+        }
+    }
+    riscv.flush(true);
+    riscv.writer = nullptr;
+    riscv.pool = nullptr;
+
+    {
+        MemoryScope memory_scope(memory, "write");
+        ok = close_output(output, ok);
+    }
+    return ok;
+}
+
+/**
+ * @brief 编译已载入 source 的源程序
+ * @param[in] mode 编译模式，-koopa 输出 Koopa IR，-riscv 输出 RISC-V 汇编
+ * @param[in] output 输出文件路径
+ * @return 是否编译成功
+ * @note 调用前需通过 source.open() 映射文件，或通过 source.load() 载入源程序文本
+ */
+bool CompilerContext::compile_source(const string& mode, const char* output) {
+    if (mode != "-koopa" && mode != "-riscv" && mode != "-interp") {
+        error("unknown mode " + mode);
+        return false;
+    }
+    this->mode = mode;
+    writer.timer = timer;
+    riscv.timer = timer;
+    riscv.stats = stats;
+    binder.stats = stats;
+    if (pipeline && mode != "-interp") {
+        if (!open_output(output)) {
+            return false;
+        }
+        auto ok = compile_pipelined();
+        MemoryScope memory_scope(memory, "write");
+        return close_output(output, ok);
+    }
+    if (cache != nullptr && mode != "-interp") {
+        if (!open_output(output)) {
+            return false;
+        }
+        auto ok = compile_cached();
+        MemoryScope memory_scope(memory, "write");
+        return close_output(output, ok);
+    }
+    if (!parse()) {
+        return false;
+    }
+    if (!bind(ast)) {
+        report_undefined();
+        return false;
+    }
+    if (mode == "-interp") {
+        // 前端在内存中构建 raw program 后直接解释执行
+        KoopaRaw koopa_raw;
+        koopa = &koopa_raw;
+        {
+            TimeScope scope(timer, "lower");
+            ast->print(*this);
+        }
+        koopa = nullptr;
+        return errors == 0 && interpret(koopa_raw.program(), output);
+    }
+    if (!open_output(output)) {
+        return false;
+    }
+
+    if (mode == "-koopa") {
+        // 每个函数的 Koopa IR 先写入内存缓冲区, 函数结束时交给后台线程写出
+        KoopaText koopa_text;
+        koopa_text.writer = &writer;
+        koopa = &koopa_text;
+        {
+            TimeScope scope(timer, "lower");
+            MemoryScope memory_scope(memory, "lower");
+            ast->print(*this);
+        }
+        koopa_text.flush();
+        koopa = nullptr;
+    }
+    else if (mode == "-riscv") {
+        // AST 直接在内存中构建 raw program, 不再输出 Koopa IR 文本后重新解析
+        KoopaRaw koopa_raw;
+        koopa = &koopa_raw;
+        {
+            TimeScope scope(timer, "lower");
+            MemoryScope memory_scope(memory, "lower");
+            ast->print(*this);
+        }
+        koopa = nullptr;
+        if (errors > 0) {
+            return close_output(output, false);
+        }
+
+        // 汇编先写入内存缓冲区, 写满的缓冲区由后台线程写出
+        unique_ptr<ThreadPool> pool;
+        if (threads > 1) {
+            pool = make_unique<ThreadPool>(threads);
+        }
+        riscv.writer = &writer;
+        riscv.pool = pool.get();
+        {
+            TimeScope scope(timer, "codegen");
+            MemoryScope memory_scope(memory, "codegen");
+            visit(koopa_raw.program(), riscv);
+        }
+        riscv.flush(true);
+        riscv.writer = nullptr;
+        riscv.pool = nullptr;
+    }
+
+    MemoryScope memory_scope(memory, "write");
+    return close_output(output, errors == 0);
+}
+
+/**
+ * @brief 解释执行 raw program 的 main 函数，将执行统计写入输出文件
+ * @param[in] raw raw program
+ * @param[in] output 输出文件路径
+ * @return 是否正常执行结束
+ * @note 程序的输出写到 program_output，为空时写到 stdout；输入从 program_input 读取，为空时从 stdin 读取；
+ * @note 执行统计写到输出文件
+ */
+bool CompilerContext::interpret(const koopa_raw_program_t& raw, const char* output) {
+    KoopaInterpreter interpreter(raw);
+    interpreter.output = program_output;
+    interpreter.input = program_input;
+    bool ok;
+    {
+        TimeScope scope(timer, "interp");
+        ok = interpreter.run();
+    }
+    if (!ok) {
+        error(interpreter.error);
+    }
+    if (!open_output(output, false)) {
+        return false;
+    }
+    OutputBuffer profile;
+    interpreter.print_profile(profile);
+    writer.submit(move(profile.buffer));
+    return close_output(output) && ok;
+}
+
+/**
+ * @brief 流水线编译
+ * @return 是否编译成功
+ * @note 当前线程解析源文件，每规约出一个函数就放入 func_queue；
+ * @note IR 线程依次取出函数，做名字解析后生成 Koopa IR，-riscv 模式下将生成的 raw 函数放入 raw_queue；
+ * @note 汇编线程依次取出 raw 函数生成汇编。各阶段同时进行，总耗时接近最慢的一个阶段
+ * @note 函数的 AST 由 parser 线程在 arena 中分配，入队后只由 IR 线程访问，编译结束时随 arena 释放
+ */
+bool CompilerContext::compile_pipelined() {
+    // 队列容量，限制阶段之间积压的函数数量
+    const size_t queue_capacity = 64;
+    BoundedQueue<BaseAST*> ast_queue(queue_capacity);
+    BoundedQueue<koopa_raw_function_t> raw_queue(queue_capacity);
+    bool to_riscv = mode == "-riscv";
+
+    KoopaText koopa_text;
+    KoopaRaw koopa_raw;
+    if (to_riscv) {
+        koopa = &koopa_raw;
+    }
+    else {
+        koopa_text.writer = &writer;
+        koopa = &koopa_text;
+    }
+
+    // IR 生成阶段
+    // 各阶段的内存统计覆盖整个线程，与同时进行的其他阶段重叠
+    thread ir_thread([&] {
+        MemoryScope memory_scope(memory, "lower");
+        BaseAST* func;
+        while (ast_queue.pop(func)) {
+            // 名字解析失败的函数不生成 IR，继续取出后续函数，使 parser 不被阻塞
+            if (!bind(func)) {
+                continue;
+            }
+            TimeScope scope(timer, "lower");
+            func->print(*this);
+            if (to_riscv) {
+                raw_queue.push(koopa_raw.last_function());
+            }
+        }
+        raw_queue.close();
+    });
+
+    // 汇编生成阶段
+    thread riscv_thread;
+    if (to_riscv) {
+        riscv.writer = &writer;
+        riscv_thread = thread([&] {
+            MemoryScope memory_scope(memory, "codegen");
+            koopa_raw_function_t func;
+            while (raw_queue.pop(func)) {
+                TimeScope scope(timer, "codegen");
+                visit(func, riscv);
+            }
+            if (riscv.instrument) {
+                profile_runtime(riscv);
+            }
+            riscv.flush(true);
+        });
+    }
+
+    // 解析阶段
+    func_queue = &ast_queue;
+    auto ok = parse();
+    func_queue = nullptr;
+    ast_queue.close();
+
+    ir_thread.join();
+    if (riscv_thread.joinable()) {
+        riscv_thread.join();
+    }
+    koopa_text.flush();
+    koopa = nullptr;
+    riscv.writer = nullptr;
+    report_undefined();
+    return ok && errors == 0;
+}
+
+/**
+ * @brief 计算函数在编译缓存中的键
+ * @param[in] func 函数的 AST
+ * @return 键，32 位十六进制字符串
+ * @note 由函数 AST 的哈希和函数中引用到的全局常量的值共同决定，
+ * @note 全局常量的值改变时，引用它的函数的键也随之改变
+ */
+string CompilerContext::function_key(const BaseAST& func) {
+    AstHasher hasher;
+    hasher.interner = &interner;
+    // 缓存格式版本，生成代码的方式改变时需要修改
+    hasher.add("sysy-cache-v1");
+    // 插桩生成的汇编不同，使用不同的键
+    if (riscv.instrument) {
+        hasher.add("instrument-cycles");
+    }
+    func.hash(hasher);
+    for (auto [ident, binding] : hasher.globals) {
+        auto& symbol = this->symbol(binding);
+        hasher.add(interner.name(ident));
+        hasher.add((int)symbol.type);
+        hasher.add(symbol.value);
+    }
+    return hasher.hex();
+}
+
+/**
+ * @brief 使用编译缓存编译
+ * @return 是否编译成功
+ * @note 逐个函数计算键，命中时直接输出缓存的内容，跳过该函数的 IR 生成与汇编生成；
+ * @note 未命中时正常生成该函数的输出并写入缓存。各函数按源顺序串行处理
+ */
+bool CompilerContext::compile_cached() {
+    if (!parse()) {
+        return false;
+    }
+    if (!bind(ast)) {
+        report_undefined();
+        return false;
+    }
+    auto program = dynamic_cast<ProgramAST*>(ast);
+    assert(program != nullptr);
+    bool to_riscv = mode == "-riscv";
+    string ext = to_riscv ? ".S" : ".koopa";
+
+    KoopaText koopa_text;
+    KoopaRaw koopa_raw;
+    koopa = to_riscv ? static_cast<Koopa*>(&koopa_raw) : &koopa_text;
+    for (auto& comp_unit : program->comp_units) {
+        string key;
+        {
+            TimeScope scope(timer, "cache");
+            key = function_key(*comp_unit);
+        }
+        string content;
+        if (!cache->load(key, ext, content)) {
+            {
+                TimeScope scope(timer, "lower");
+                MemoryScope memory_scope(memory, "lower");
+                comp_unit->print(*this);
+            }
+            // 生成 IR 时出错的函数不写入缓存
+            if (errors > 0) {
+                break;
+            }
+            if (to_riscv) {
+                TimeScope scope(timer, "codegen");
+                MemoryScope memory_scope(memory, "codegen");
+                Riscv part;
+                part.timer = timer;
+                part.stats = stats;
+                part.instrument = riscv.instrument;
+                visit(koopa_raw.last_function(), part);
+                content = move(part.buffer.buffer);
+            }
+            else {
+                content = move(koopa_text.buffer.buffer);
+                koopa_text.buffer.clear();
+            }
+            cache->store(key, ext, content);
+        }
+        writer.submit(move(content));
+        // 命中缓存的函数也需要转储其计数器
+        auto func = dynamic_cast<FuncDefAST*>(comp_unit);
+        if (to_riscv && riscv.instrument && func != nullptr) {
+            riscv.profiled.emplace_back(func->ident);
+        }
+    }
+    if (to_riscv && riscv.instrument) {
+        profile_runtime(riscv);
+        writer.submit(move(riscv.buffer.buffer));
+        riscv.buffer.clear();
+    }
+    koopa = nullptr;
+    return errors == 0;
+}
@@ -0,0 +1,446 @@
+#include "include/ast.hpp"
+
+// Binder
+
+/**
+ * @brief 进入一层作用域
+ */
+void Binder::enter_scope() {
+    marks.push_back(undo.size());
+}
+
+/**
+ * @brief 离开一层作用域，恢复该层中的定义遮蔽的绑定
+ */
+void Binder::exit_scope() {
+    auto mark = marks.back();
+    marks.pop_back();
+    while (undo.size() > mark) {
+        auto [ident, previous] = undo.back();
+        undo.pop_back();
+        bindings[ident] = previous;
+    }
+}
+
+/**
+ * @brief 进入函数，函数的槽位从 0 开始重新编号
+ */
+void Binder::enter_function() {
+    local_slots = 0;
+    enter_scope();
+}
+
+/**
+ * @brief 离开函数
+ * @return 函数使用的槽位数
+ */
+int Binder::exit_function() {
+    exit_scope();
+    return local_slots;
+}
+
+/**
+ * @brief 在当前作用域中定义标识符，分配一个新的槽位
+ * @param[in] ident 标识符的驻留编号
+ * @return 新的绑定，遮蔽外层作用域中的同名定义
+ */
+Binding Binder::define(int ident) {
+    if ((size_t)ident >= bindings.size()) {
+        bindings.resize(ident + 1);
+    }
+    Binding binding;
+    if (marks.empty()) {
+        binding = Binding{ Binding::GLOBAL, global_slots++ };
+    }
+    else {
+        binding = Binding{ Binding::LOCAL, local_slots++ };
+        undo.emplace_back(ident, bindings[ident]);
+    }
+    bindings[ident] = binding;
+    return binding;
+}
+
+/**
+ * @brief 查找标识符当前可见的绑定
+ * @param[in] ident 标识符的驻留编号
+ * @return 绑定，未定义时 scope 为 UNBOUND，并记入 undefined
+ */
+Binding Binder::resolve(int ident) {
+    STAT_(stats, symbol_lookups);
+    if ((size_t)ident >= bindings.size() || bindings[ident].scope == Binding::UNBOUND) {
+        undefined.push_back(ident);
+        return Binding();
+    }
+    return bindings[ident];
+}
+
+
+// EnvironmentManager
+
+string EnvironmentManager::get_short_true_label() {
+    return "%short_true_" + to_string(short_circuit_count);
+}
+
+string EnvironmentManager::get_short_false_label() {
+    return "%short_false_" + to_string(short_circuit_count);
+}
+
+string EnvironmentManager::get_short_end_label() {
+    return "%short_end_" + to_string(short_circuit_count);
+}
+
+string EnvironmentManager::get_short_result_reg() {
+    return "%short_result_" + to_string(short_circuit_count);
+}
+
+void EnvironmentManager::add_short_circuit_count() {
+    short_circuit_count++;
+}
+
+int EnvironmentManager::get_temp_count() {
+    return temp_count;
+}
+
+
+// AstHasher
+
+/**
+ * @brief 以 32 位十六进制字符串输出哈希值
+ */
+string AstHasher::hex() const {
+    static const char digits[] = "0123456789abcdef";
+    string result(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        result[15 - i] = digits[(h1 >> (4 * i)) & 0xf];
+        result[31 - i] = digits[(h2 >> (4 * i)) & 0xf];
+    }
+    return result;
+}
+
+
+// KoopaText
+
+/**
+ * @brief Koopa 二元运算符的文本形式，下标为 koopa_raw_binary_op_t
+ */
+static const char* binary_op_name[] = {
+    "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul",
+    "div", "mod", "and", "or", "xor", "shl", "shr", "sar"
+};
+
+/**
+ * @brief 将缓冲区交给写出线程，每个函数结束时调用一次
+ */
+void KoopaText::flush() {
+    if (writer != nullptr) {
+        writer->submit(move(buffer.buffer));
+    }
+}
+
+/**
+ * @brief 生成函数头，即 `fun @ident(): i32 {`
+ * @param[in] ident 函数名
+ * @param[in] is_int 返回值是否为 i32
+ */
+void KoopaText::_fun(string_view ident, bool is_int) {
+    buffer << '\n';
+    buffer << "fun @" << ident << "()" << (is_int ? ": i32" : ": void") << " {\n";
+}
+
+/**
+ * @brief 生成函数结尾，即 `}`
+ */
+void KoopaText::_end_fun() {
+    buffer << "}\n";
+    flush();
+}
+
+/**
+ * @brief 生成基本块标号，即 `name:`
+ * @param[in] name 基本块名
+ */
+void KoopaText::_label(const string& name) {
+    buffer << name << ":\n";
+}
+
+/**
+ * @brief 生成二元运算指令，即 `rd = op lhs, rhs`
+ */
+void KoopaText::_binary(koopa_raw_binary_op_t op, const Result& rd, const Result& lhs, const Result& rhs) {
+    buffer << "\t" << rd << " = " << binary_op_name[op] << " " << lhs << ", " << rhs << '\n';
+}
+
+/**
+ * @brief 生成 alloc 指令，即 `name = alloc i32`
+ */
+void KoopaText::_alloc(const string& name) {
+    buffer << "\t" << name << " = alloc i32\n";
+}
+
+/**
+ * @brief 生成 load 指令，即 `rd = load src`
+ */
+void KoopaText::_load(const Result& rd, const string& src) {
+    buffer << "\t" << rd << " = load " << src << '\n';
+}
+
+/**
+ * @brief 生成 store 指令，即 `store value, dest`
+ */
+void KoopaText::_store(const Result& value, const string& dest) {
+    buffer << "\tstore " << value << ", " << dest << '\n';
+}
+
+/**
+ * @brief 生成 br 指令，即 `br cond, true_label, false_label`
+ */
+void KoopaText::_br(const Result& cond, const string& true_label, const string& false_label) {
+    buffer << "\tbr " << cond << ", " << true_label << ", " << false_label << '\n';
+}
+
+/**
+ * @brief 生成 jump 指令，即 `jump label`
+ */
+void KoopaText::_jump(const string& label) {
+    buffer << "\tjump " << label << '\n';
+}
+
+/**
+ * @brief 生成无返回值的 ret 指令
+ */
+void KoopaText::_ret() {
+    buffer << "\tret\n";
+}
+
+/**
+ * @brief 生成带返回值的 ret 指令
+ */
+void KoopaText::_ret(const Result& value) {
+    buffer << "\tret " << value << '\n';
+}
+
+
+// KoopaRaw
+
+koopa_raw_type_t KoopaRaw::type_i32() {
+    static const koopa_raw_type_kind_t i32 = { KOOPA_RTT_INT32, {} };
+    return &i32;
+}
+
+koopa_raw_type_t KoopaRaw::type_unit() {
+    static const koopa_raw_type_kind_t unit = { KOOPA_RTT_UNIT, {} };
+    return &unit;
+}
+
+koopa_raw_type_t KoopaRaw::type_ptr_i32() {
+    static koopa_raw_type_kind_t ptr_i32 = [] {
+        koopa_raw_type_kind_t ty = { KOOPA_RTT_POINTER, {} };
+        ty.data.pointer.base = type_i32();
+        return ty;
+    }();
+    return &ptr_i32;
+}
+
+/**
+ * @brief 复制一份名字，使其生命周期与 raw program 一致
+ */
+const char* KoopaRaw::new_name(const string& name) {
+    names.push_back(name);
+    return names.back().c_str();
+}
+
+/**
+ * @brief 由元素列表生成切片，列表在生成切片后不可再修改
+ */
+koopa_raw_slice_t KoopaRaw::new_slice(vector<const void*>* items, koopa_raw_slice_item_kind_t kind) {
+    if (items == nullptr || items->empty()) {
+        return { nullptr, 0, kind };
+    }
+    return { items->data(), static_cast<uint32_t>(items->size()), kind };
+}
+
+/**
+ * @brief 创建一个未命名、未被使用的 value
+ */
+koopa_raw_value_data_t* KoopaRaw::new_value(koopa_raw_type_t ty, koopa_raw_value_tag_t tag) {
+    values.emplace_back();
+    auto value = &values.back();
+    value->ty = ty;
+    value->name = nullptr;
+    value->used_by = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    value->kind.tag = tag;
+    return value;
+}
+
+/**
+ * @brief 获取 Result 对应的 value
+ * @note 立即数每次使用时新建一个 integer value，寄存器返回定义它的指令
+ */
+koopa_raw_value_t KoopaRaw::value_of(const Result& result) {
+    if (result.type == Result::Type::IMM) {
+        auto value = new_value(type_i32(), KOOPA_RVT_INTEGER);
+        value->kind.data.integer.value = result.value;
+        return value;
+    }
+    assert(result.value >= 0 && result.value < (int)regs.size() && regs[result.value] != nullptr);
+    return regs[result.value];
+}
+
+/**
+ * @brief 将指令加入当前基本块，若 rd 为寄存器则记录其定义
+ */
+void KoopaRaw::define(const Result& rd, koopa_raw_value_data_t* value) {
+    if (rd.type == Result::Type::REG) {
+        if (rd.value >= (int)regs.size()) {
+            regs.resize(rd.value + 1, nullptr);
+        }
+        regs[rd.value] = value;
+    }
+    assert(cur_insts != nullptr);
+    cur_insts->push_back(value);
+}
+
+/**
+ * @brief 获取名为 name 的基本块，不存在则新建
+ */
+koopa_raw_basic_block_t KoopaRaw::block_of(const string& name) {
+    auto it = bb_table.find(name);
+    if (it != bb_table.end()) {
+        return it->second.first;
+    }
+    bbs.emplace_back();
+    auto bb = &bbs.back();
+    bb->name = new_name(name);
+    bb->params = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    bb->used_by = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    slices.emplace_back();
+    bb_table[name] = { bb, &slices.back() };
+    return bb;
+}
+
+/**
+ * @brief 开始构建函数
+ * @param[in] ident 函数名
+ * @param[in] is_int 返回值是否为 i32
+ */
+void KoopaRaw::_fun(string_view ident, bool is_int) {
+    types.emplace_back();
+    auto ty = &types.back();
+    ty->tag = KOOPA_RTT_FUNCTION;
+    ty->data.function.params = new_slice(nullptr, KOOPA_RSIK_TYPE);
+    ty->data.function.ret = is_int ? type_i32() : type_unit();
+
+    funcs.emplace_back();
+    cur_func = &funcs.back();
+    cur_func->ty = ty;
+    cur_func->name = new_name("@" + string(ident));
+    cur_func->params = new_slice(nullptr, KOOPA_RSIK_VALUE);
+
+    slices.emplace_back();
+    cur_bbs = &slices.back();
+    cur_insts = nullptr;
+    bb_table.clear();
+    symbol_table.clear();
+    regs.clear();
+}
+
+/**
+ * @brief 结束构建函数，生成函数和各基本块的切片
+ */
+void KoopaRaw::_end_fun() {
+    for (auto bb : *cur_bbs) {
+        auto& entry = bb_table.at(reinterpret_cast<koopa_raw_basic_block_t>(bb)->name);
+        entry.first->insts = new_slice(entry.second, KOOPA_RSIK_VALUE);
+    }
+    cur_func->bbs = new_slice(cur_bbs, KOOPA_RSIK_BASIC_BLOCK);
+    func_list.push_back(cur_func);
+    cur_func = nullptr;
+    cur_bbs = nullptr;
+    cur_insts = nullptr;
+}
+
+/**
+ * @brief 开始一个新的基本块，后续指令加入该基本块
+ */
+void KoopaRaw::_label(const string& name) {
+    auto bb = block_of(name);
+    cur_bbs->push_back(bb);
+    cur_insts = bb_table[name].second;
+}
+
+void KoopaRaw::_binary(koopa_raw_binary_op_t op, const Result& rd, const Result& lhs, const Result& rhs) {
+    auto value = new_value(type_i32(), KOOPA_RVT_BINARY);
+    value->kind.data.binary.op = op;
+    value->kind.data.binary.lhs = value_of(lhs);
+    value->kind.data.binary.rhs = value_of(rhs);
+    define(rd, value);
+}
+
+void KoopaRaw::_alloc(const string& name) {
+    auto value = new_value(type_ptr_i32(), KOOPA_RVT_ALLOC);
+    value->name = new_name(name);
+    symbol_table[name] = value;
+    define(Result(), value);
+}
+
+void KoopaRaw::_load(const Result& rd, const string& src) {
+    auto value = new_value(type_i32(), KOOPA_RVT_LOAD);
+    value->kind.data.load.src = symbol_table.at(src);
+    define(rd, value);
+}
+
+void KoopaRaw::_store(const Result& value, const string& dest) {
+    auto store = new_value(type_unit(), KOOPA_RVT_STORE);
+    store->kind.data.store.value = value_of(value);
+    store->kind.data.store.dest = symbol_table.at(dest);
+    define(Result(), store);
+}
+
+void KoopaRaw::_br(const Result& cond, const string& true_label, const string& false_label) {
+    auto value = new_value(type_unit(), KOOPA_RVT_BRANCH);
+    value->kind.data.branch.cond = value_of(cond);
+    value->kind.data.branch.true_bb = block_of(true_label);
+    value->kind.data.branch.false_bb = block_of(false_label);
+    value->kind.data.branch.true_args = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    value->kind.data.branch.false_args = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    define(Result(), value);
+}
+
+void KoopaRaw::_jump(const string& label) {
+    auto value = new_value(type_unit(), KOOPA_RVT_JUMP);
+    value->kind.data.jump.target = block_of(label);
+    value->kind.data.jump.args = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    define(Result(), value);
+}
+
+void KoopaRaw::_ret() {
+    auto value = new_value(type_unit(), KOOPA_RVT_RETURN);
+    value->kind.data.ret.value = nullptr;
+    define(Result(), value);
+}
+
+void KoopaRaw::_ret(const Result& result) {
+    auto value = new_value(type_unit(), KOOPA_RVT_RETURN);
+    value->kind.data.ret.value = value_of(result);
+    define(Result(), value);
+}
+
+/**
+ * @brief 获取构建完成的 raw program
+ * @note 返回的 program 在 KoopaRaw 对象析构前有效
+ */
+koopa_raw_program_t KoopaRaw::program() {
+    koopa_raw_program_t program;
+    program.values = new_slice(nullptr, KOOPA_RSIK_VALUE);
+    program.funcs = new_slice(&func_list, KOOPA_RSIK_FUNCTION);
+    return program;
+}
+
+/**
+ * @brief 获取最近一个构建完成的函数，供流水线模式逐个交给后端
+ * @note 之后继续构建其他函数不会使已返回的函数失效
+ */
+koopa_raw_function_t KoopaRaw::last_function() {
+    assert(!func_list.empty());
+    return reinterpret_cast<koopa_raw_function_t>(func_list.back());
+}
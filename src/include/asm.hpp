@@ -5,16 +5,22 @@
 #include <cassert>
 #include <fstream>
 #include <cstring>
+#include <string>
+#include <vector>
 #include "include/backend_utils.hpp"
 
 using namespace std;
 
-extern ofstream koopa_ofs;
-extern ofstream riscv_ofs;
+class Riscv;
 
-void visit(const koopa_raw_program_t& program);
-void visit(const koopa_raw_slice_t& slice);
-void visit(const koopa_raw_function_t& func);
-void visit(const koopa_raw_basic_block_t& bb);
-void visit(const koopa_raw_value_t& value);
-void visit(const koopa_raw_return_t& ret);
\ No newline at end of file
+bool check_supported(const koopa_raw_program_t& program, string& unsupported);
+void visit(const koopa_raw_program_t& program, Riscv& riscv);
+void visit(const koopa_raw_slice_t& slice, Riscv& riscv);
+void visit(const koopa_raw_function_t& func, Riscv& riscv);
+void visit(const koopa_raw_basic_block_t& bb, Riscv& riscv);
+void visit(const koopa_raw_value_t& value, Riscv& riscv);
+void visit(const koopa_raw_return_t& ret, Riscv& riscv);
+void visit_parallel(const koopa_raw_slice_t& funcs, Riscv& riscv);
+void profile_prologue(Riscv& riscv);
+void profile_epilogue(Riscv& riscv);
+void profile_runtime(Riscv& riscv);
@@ -2,26 +2,31 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <vector>
-#include <optional>
 #include <cassert>
+#include <cstdint>
 #include "include/frontend_utils.hpp"
 
 using namespace std;
 
 
-extern string mode;
-extern ofstream koopa_ofs;
-extern ofstream riscv_ofs;
+class CompilerContext;
 
 /**
  * @brief 所有 AST 的基类
+ * @note 节点由 parser 在编译上下文的 arena 中分配，子节点为 arena 中的裸指针，
+ * @note 随 arena 一次释放，不调用析构函数，节点不能持有需要析构的成员
  */
 class BaseAST {
  public:
   virtual ~BaseAST() = default;
-  virtual Result print() const = 0;
+  virtual Result print(CompilerContext& ctx) const = 0;
+  // 计算 AST 的哈希，结构相同的 AST 哈希相同，用于编译缓存
+  virtual void hash(AstHasher& hasher) const = 0;
+  // 名字解析，把定义和使用绑定到槽位，结果保存在节点中
+  virtual void bind(Binder& binder) = 0;
 };
 
 /**
@@ -29,8 +34,10 @@ class BaseAST {
  */
 class ProgramAST : public BaseAST {
  public:
-  vector<unique_ptr<BaseAST>> comp_units;
-  Result print() const override;
+  ArenaSlice<BaseAST*> comp_units;
+  Result print(CompilerContext& ctx) const override;
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
 };
 
 
@@ -45,14 +52,19 @@ public:
     VOID
   };
   FuncType func_type;  
-  // 函数名
-  string ident;
+  // 函数名，指向源文件映射
+  string_view ident;
   // 函数参数列表 (to do)
-  // vector<unique_ptr<BaseAST>>* func_params;
+  // ArenaSlice<BaseAST*>* func_params;
   // 函数体                   
-  unique_ptr<BaseAST> block;    
+  BaseAST* block;    
+  // 函数中常量与变量使用的槽位数，由名字解析确定
+  int slots = 0;
 
-  Result print() const override;
+  Result print(CompilerContext& ctx) const override;
+
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
 };
 
 
@@ -62,9 +74,12 @@ public:
 class BlockAST : public BaseAST {
 public:
   // 基本块中内容
-  vector<unique_ptr<BaseAST>> block_items;
+  ArenaSlice<BaseAST*> block_items;
+
+  Result print(CompilerContext& ctx) const override;
 
-  Result print() const override;
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
 };
 
 /**
@@ -73,8 +88,10 @@ public:
 class ConstDeclAST : public BaseAST {
 public:
   // 常量定义列表
-  vector<unique_ptr<BaseAST>> const_defs;
-  Result print() const override;
+  ArenaSlice<BaseAST*> const_defs;
+  Result print(CompilerContext& ctx) const override;
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
 };
 
 /**
@@ -82,11 +99,15 @@ public:
 */
 class ConstDefAST : public BaseAST {
 public:
-  // 常量名
-  string ident;
+  // 常量名的驻留编号
+  int ident;
+  // 常量的槽位，由名字解析确定
+  Binding binding;
   // 初始化常量值
-  unique_ptr<BaseAST> value;
-  Result print() const override;
+  BaseAST* value;
+  Result print(CompilerContext& ctx) const override;
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
 };
 
 /**
@@ -94,10 +115,12 @@ public:
 */
 class ConstInitValAST : public BaseAST {
 public:
-    // 常量表达式
-    optional<unique_ptr<BaseAST>> const_exp;
+    // 常量表达式，可为空
+    BaseAST* const_exp = nullptr;
     // 打印普通常量初始化值
-    Result print() const override;
+    Result print(CompilerContext& ctx) const override;
+    void hash(AstHasher& hasher) const override;
+    void bind(Binder& binder) override;
 };
  
  /**
@@ -106,8 +129,10 @@ public:
  class ConstExpAST : public BaseAST {
  public:
      // 常量表达式
-     unique_ptr<BaseAST> exp;
-     Result print() const override;
+     BaseAST* exp;
+     Result print(CompilerContext& ctx) const override;
+     void hash(AstHasher& hasher) const override;
+     void bind(Binder& binder) override;
  };
 
 /**
@@ -116,8 +141,10 @@ public:
 class StmtReturnAST : public BaseAST {
 public:
   // 返回值，可为空
-  optional<unique_ptr<BaseAST>> exp;
-  Result print() const override;
+  BaseAST* exp = nullptr;
+  Result print(CompilerContext& ctx) const override;
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
 };
 
 /**
@@ -125,240 +152,87 @@ public:
  */
  class LValAST : public BaseAST {
   public:
-      // 变量名
-      string ident;
+      // 变量名的驻留编号
+      int ident;
+      // 变量所引用的定义的槽位，由名字解析确定
+      Binding binding;
       // 打印左值
-      Result print() const override;
-  };
-
-/**
- * @brief 表达式 AST 类
- */
-class ExpAST : public BaseAST {
-public:
-    // 逻辑或表达式
-    unique_ptr<BaseAST> l_or_exp;
-    Result print() const override;
-};
-
-/**
-* @brief 逻辑或表达式 AST 类
-*/
-class LOrExpAST : public BaseAST {
-public:
-  // 逻辑与表达式
-  unique_ptr<BaseAST> l_and_exp;
-  Result print() const override;
-};
-
-/**
-  * @brief 逻辑与表达式 AST 类
-  */
-class LAndExpAST : public BaseAST {
-public:
-  // 等值表达式
-  unique_ptr<BaseAST> eq_exp;
-  Result print() const override;
-};
-
-/**
-  * @brief 逻辑与表达式 AST 类
-  */
-class LExpWithOpAST : public BaseAST {
-public:
-  // 逻辑运算符
-  enum class LogicalOp {
-      LOGICAL_OR,
-      LOGICAL_AND
-  };
-  LogicalOp logical_op;
-  // 左操作数
-  unique_ptr<BaseAST> left;
-  // 右操作数
-  unique_ptr<BaseAST> right;
-  Result print() const override;
-};
-
-/**
-  * @brief 等值表达式 AST 类
-  */
-class EqExpAST : public BaseAST {
-public:
-  // 关系表达式
-  unique_ptr<BaseAST> rel_exp;
-  Result print() const override;
-};
-
-/**
-  * @brief 等值表达式 AST 类
-  */
-class EqExpWithOpAST : public BaseAST {
-public:
-  // 等值运算符
-  enum class EqOp {
-      EQ,
-      NEQ
-  };
-  EqOp eq_op;
-  // 左操作数
-  unique_ptr<BaseAST> left;
-  // 右操作数
-  unique_ptr<BaseAST> right;
-  // 将字符串形式的运算符转换为等值运算符
-  EqOp convert(const string& op) const;
-  Result print() const override;
-};
-  
-/**
-  * @brief 关系表达式 AST 类
-  */
-class RelExpAST : public BaseAST {
-public:
-  // 加法表达式
-  unique_ptr<BaseAST> add_exp;
-  Result print() const override;
-};
-  
-/**
-  * @brief 关系表达式 AST 类
-*/
-class RelExpWithOpAST : public BaseAST {
-public:
-  // 关系运算符
-  enum class RelOp {
-      LE,
-      GE,
-      LT,
-      GT
+      Result print(CompilerContext& ctx) const override;
+      void hash(AstHasher& hasher) const override;
+      void bind(Binder& binder) override;
   };
-  RelOp rel_op;
-  // 左操作数
-  unique_ptr<BaseAST> left;
-  // 右操作数
-  unique_ptr<BaseAST> right;
-  // 将字符串形式的运算符转换为关系运算符
-  RelOp convert(const string& op) const;
-  Result print() const override;
-};
-
-
-/**
- * @brief 加法表达式 AST 类
- */
-class AddExpAST : public BaseAST {
-public:
-  // 乘法表达式
-  unique_ptr<BaseAST> mul_exp;
-  Result print() const override;
-};
 
 /**
- * @brief 加法表达式(带符号) AST 类
+ * @brief 表达式运算符，叶子节点也由运算符区分
  */
-class AddExpWithOpAST : public BaseAST {
-public:
-  // 加法运算符
-  enum class AddOp {
-      ADD,
-      SUB
-  };
-  AddOp add_op;
-  // 左操作数
-  unique_ptr<BaseAST> left;
-  // 右操作数
-  unique_ptr<BaseAST> right;
-  // 将字符串形式的运算符转换为加法运算符
-  AddOp convert(const string& op) const;
-  Result print() const override;
-};
-
-/**
- * @brief 乘法表达式 AST 类
+enum class ExprOp : uint8_t {
+  // 叶子：数字字面量、左值
+  NUMBER,
+  LVAL,
+  // 一元运算
+  POSITIVE,
+  NEGATIVE,
+  NOT,
+  // 二元运算
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  LT,
+  GT,
+  LE,
+  GE,
+  EQ,
+  NEQ,
+  // 短路求值的逻辑运算
+  LOGICAL_AND,
+  LOGICAL_OR
+};
+
+/**
+ * @brief 紧凑表达式树的节点，只有运算符节点和叶子节点，没有单纯转发的包装节点
+ * @note - 子节点以在同一数组中的下标表示，子节点总在父节点之前，根节点是最后一个
+ * @note - NUMBER：lhs 为字面量的值；LVAL：lhs 为左值在 ExpAST::l_vals 中的下标
+ * @note - 一元运算：lhs 为操作数；二元运算：lhs / rhs 为左右操作数
  */
-class MulExpAST : public BaseAST {
-public:
-  // 一元表达式
-  unique_ptr<BaseAST> unary_exp;
-  Result print() const override;
+struct ExprNode {
+  ExprOp op;
+  int32_t lhs;
+  int32_t rhs;
 };
 
 /**
- * @brief 乘法表达式(带符号) AST 类
+ * @brief 表达式 AST 类，整棵表达式树存放在一个连续数组中
+ * @note 由 ExprBuilder 在解析时构建，降级时按下标递归，不经过虚函数调用
  */
-class MulExpWithOpAST : public BaseAST {
-public:
-  // 乘法运算符
-  enum class MulOp {
-    MUL,
-    DIV,
-    MOD
-  };
-  MulOp mul_op;
-  // 左操作数
-  unique_ptr<BaseAST> left;
-  // 右操作数
-  unique_ptr<BaseAST> right;
-  // 将字符串形式的运算符转换为乘法运算符
-  MulOp convert(const string& op) const;
-  Result print() const override;
-};
-
-/**
- * @brief 一元表达式 AST 类
- */
-class UnaryExpAST : public BaseAST {
-public:
-    // 优先表达式
-    unique_ptr<BaseAST> primary_exp;
-    Result print() const override;
-};
-  
-
-/**
- * @brief 带运算符的一元表达式 AST 类
- */
-class UnaryExpWithOpAST : public BaseAST {
-public:
-  // 一元操作符  
-  enum class UnaryOp {
-    POSITIVE,
-    NEGATIVE,
-    NOT
-  };
-  UnaryOp unary_op;
-  // 一元表达式
-  unique_ptr<BaseAST> unary_exp;
-  // 将字符串形式的运算符转换为一元运算符
-  UnaryOp convert(const string& op) const;
-  Result print() const override;
-};
-
-/**
- * @brief 优先表达式 AST 类
- */
-class PrimaryExpAST : public BaseAST {
+class ExpAST : public BaseAST {
 public:
-  // 表达式
-  unique_ptr<BaseAST> exp;
-  Result print() const override;
+  // 表达式节点，后序排列
+  ArenaSlice<ExprNode> nodes;
+  // 表达式中引用的左值
+  ArenaSlice<LValAST*> l_vals;
+  Result print(CompilerContext& ctx) const override;
+  void hash(AstHasher& hasher) const override;
+  void bind(Binder& binder) override;
+private:
+  Result print_node(int32_t index, CompilerContext& ctx) const;
 };
 
 /**
- * @brief 数字字面量优先表达式 AST 类
+ * @brief 表达式构建器，parser 规约表达式时向其中追加节点
+ * @note - 返回的下标只在当前表达式内有效，由 finish() 复制到 arena 中的 ExpAST 后清空
+ * @note - 括号中的表达式不单独 finish，与外层表达式共用一个数组
+ * @note - 只由 parser 线程使用
  */
-class PrimaryExpWithNumberAST : public BaseAST {
+class ExprBuilder {
+private:
+  vector<ExprNode> nodes;
+  vector<LValAST*> l_vals;
 public:
-  // 字面量
-  int number;
-  Result print() const override;
+  int32_t number(int value);
+  int32_t l_val(LValAST* l_val);
+  int32_t unary(ExprOp op, int32_t operand);
+  int32_t binary(ExprOp op, int32_t lhs, int32_t rhs);
+  ExpAST* finish(Arena& arena);
 };
-
-/**
- * @brief 左值优先表达式 AST 类
- */
- class PrimaryExpWithLValAST : public BaseAST {
-  public:
-      // 左值
-      unique_ptr<BaseAST> l_val;
-      Result print() const override;
-  };
\ No newline at end of file
@@ -6,23 +6,53 @@
 
 using namespace std;
 
-void parse_riscv(const char* koopa_ir);
+class Riscv;
+
+bool parse_raw(const char* koopa_ir, koopa_raw_program_builder_t& builder, koopa_raw_program_t& raw, TimeReport* timer);
+const char* value_kind_name(koopa_raw_value_tag_t tag);
 
 /**
  * @brief Riscv 类，用于生成 Riscv 汇编代码
  * @note - 包含 Riscv 汇编代码的生成方法
- * @note - 会自动处理偏置量，使之不超过 12 位限制
+ * @note - 会自动处理偏置量，使之不超过 12 位限制：超出时先用 li 将其存入 scratch 寄存器
+ * @note - 指令先格式化到 buffer 中，由 flush() 交给 writer 写出，不逐条刷新输出流
  */
 class Riscv {
 public:
+    // 单个缓冲区超过该大小后在函数结束时写出
+    static constexpr size_t flush_threshold = 1 << 20;
+    // 展开超出 12 位的立即数与偏移量时使用的临时寄存器，其他指令不应使用
+    static constexpr const char* scratch = "t6";
+    // 当前输出缓冲区
+    OutputBuffer buffer;
+    // 输出线程，为空时输出保留在 buffer 中
+    AsyncWriter* writer = nullptr;
+    // 线程池，不为空时各函数并行生成，再按源顺序拼接
+    ThreadPool* pool = nullptr;
+    // 计时报告，不为空时记录每个函数的汇编生成耗时
+    TimeReport* timer = nullptr;
+    // 统计信息，不为空时统计各方法生成的指令数
+    Stats* stats = nullptr;
+    // 是否在函数入口与出口插入 rdcycle / rdinstret 计数
+    bool instrument = false;
+    // 已插桩的函数名，按生成顺序排列，用于生成计数器转储例程
+    vector<string> profiled;
+    // 当前正在生成的函数名
+    string func_name;
+
+    void flush(bool force = false);
+
     // 特殊语句
 
+    void _blank();
     void _data();
     void _text();
     void _globl(const string& name);
     void _word(const int& value);
     void _zero(const int& len);
     void _label(const string& name);
+    void _asciz(const string& str);
+    void _align(const int& exp);
 
     // 单目运算
 
@@ -50,6 +80,7 @@ public:
     // 访存
 
     void _lw(const string& rd, const string& base, const int& bias);
+    void _lbu(const string& rd, const string& base, const int& bias);
     void _sw(const string& rs, const string& base, const int& bias);
 
     // 分支
@@ -59,6 +90,11 @@ public:
     void _beqz(const string& cond, const string& label);
     
 
+    // 性能计数器
+
+    void _rdcycle(const string& rd);
+    void _rdinstret(const string& rd);
+
     // 调用与返回
 
     void _call(const string& ident);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief 批量编译中的一个任务
+ * @note - `mode`：编译模式，-koopa / -riscv
+ * @note - `input`：源文件路径
+ * @note - `output`：输出文件路径
+ */
+struct BatchJob {
+    string mode;
+    string input;
+    string output;
+};
+
+int run_batch(int argc, const char* argv[]);
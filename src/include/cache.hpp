@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief 按内容寻址的函数级编译缓存
+ * @note - 每个函数的输出以 `<键>.<扩展名>` 的文件名保存在缓存目录中
+ * @note - 键由函数的 AST 哈希和其引用的全局常量的值计算得到，见 CompilerContext::function_key()
+ * @note - 写入时先写临时文件再重命名，多个进程共用同一缓存目录也不会读到不完整的文件
+ */
+class CompileCache {
+private:
+    string dir;
+public:
+    atomic<size_t> hits{0};
+    atomic<size_t> misses{0};
+
+    bool open(const string& dir);
+    bool load(const string& key, const string& ext, string& content);
+    void store(const string& key, const string& ext, const string& content);
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "include/ast.hpp"
+#include "include/backend_utils.hpp"
+#include "include/cache.hpp"
+
+using namespace std;
+
+/**
+ * @brief 编译上下文，持有一次编译所需的全部状态
+ * @note - 包括模式、源文件映射、lexer 句柄、AST、符号表、环境管理器和输出
+ * @note - 不使用任何全局状态，不同的 CompilerContext 可以在不同线程中同时编译
+ * @note - 前端通过 print(ctx) 访问上下文，后端通过 riscv 输出汇编
+ */
+class CompilerContext {
+public:
+    // 编译模式，-koopa / -riscv
+    string mode = "-debug";
+    // 后端生成汇编使用的线程数，大于 1 时各函数并行生成
+    size_t threads = 1;
+    // 是否使用流水线模式，解析、IR 生成、汇编生成分别在不同线程中进行
+    bool pipeline = false;
+    // 编译缓存，为空时不使用缓存
+    CompileCache* cache = nullptr;
+    // 计时报告，为空时不计时
+    TimeReport* timer = nullptr;
+    // 内存报告，为空时不统计
+    MemoryReport* memory = nullptr;
+    // 统计信息，为空时不统计
+    Stats* stats = nullptr;
+    // 诊断信息，为空时直接输出到 stderr，服务模式下收集后返回给客户端
+    string* diagnostics = nullptr;
+    // -interp 模式下程序的输出，为空时写到 stdout
+    string* program_output = nullptr;
+    // -interp 模式下程序的输入，为空时从 stdin 读取
+    const string* program_input = nullptr;
+    // 已报告的错误数，生成 IR 时报告的错误在阶段结束后使编译失败
+    size_t errors = 0;
+    // 流水线模式下，parser 将规约得到的函数放入该队列
+    BoundedQueue<BaseAST*>* func_queue = nullptr;
+    // 源文件映射，AST 中的标识符指向其中的字符
+    MappedFile source;
+    // 标识符驻留表，由 lexer 填充，符号表以其中的编号为键
+    Interner interner;
+    // AST 节点与 parser 临时列表的 arena，随编译上下文一次释放
+    Arena arena;
+    // 语法树，分配在 arena 中
+    BaseAST* ast = nullptr;
+    // parser 构建紧凑表达式树使用的构建器
+    ExprBuilder expr_builder;
+
+    // 名字解析器，在生成 IR 之前为 AST 中的定义和使用分配槽位
+    Binder binder;
+    // 全局符号，下标为全局槽位
+    vector<Symbol> global_symbols;
+    // 当前函数的符号，下标为函数内槽位，进入函数时按其槽位数重置
+    vector<Symbol> local_symbols;
+    // 前端环境管理器
+    EnvironmentManager environment_manager;
+    // Koopa IR 生成器，文本输出或内存构建
+    Koopa* koopa = nullptr;
+    // Riscv 辅助类，用于生成 riscv 汇编代码
+    Riscv riscv;
+    // 输出文件
+    AsyncWriter writer;
+
+    CompilerContext() = default;
+    CompilerContext(const CompilerContext&) = delete;
+    CompilerContext& operator=(const CompilerContext&) = delete;
+
+    /**
+     * @brief 读写绑定所指的符号
+     * @param[in] binding 名字解析得到的绑定
+     */
+    Symbol& symbol(const Binding& binding) {
+        if (binding.scope == Binding::GLOBAL) {
+            if ((size_t)binding.slot >= global_symbols.size()) {
+                global_symbols.resize(binding.slot + 1);
+            }
+            return global_symbols[binding.slot];
+        }
+        return local_symbols[binding.slot];
+    }
+
+    void error(const string& message);
+    bool parse();
+    bool bind(BaseAST* ast);
+    void report_undefined();
+    bool compile(const string& mode, const char* input, const char* output);
+    bool compile_source(const string& mode, const char* output);
+    bool compile_koopa(const string& mode, const char* output);
+    string function_key(const BaseAST& func);
+private:
+    mutex error_mutex;
+
+    bool open_output(const char* output, bool background = true);
+    bool close_output(const char* output, bool ok = true);
+    bool compile_pipelined();
+    bool interpret(const koopa_raw_program_t& raw, const char* output);
+    bool compile_cached();
+};
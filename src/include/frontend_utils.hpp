@@ -2,12 +2,17 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <fstream>
 #include <optional>
 #include <vector>
 #include <unordered_map>
+#include <deque>
 #include <cassert>
+#include <cstdint>
+#include "koopa.h"
+#include "include/other_utils.hpp"
 
 using namespace std;
 
@@ -42,27 +47,77 @@ public:
 #define ARR_(value) Symbol(Symbol::Type::ARR, value)
 #define PTR_(value) Symbol(Symbol::Type::PTR, value)
 
- /**
-  * @brief 符号表类，管理变量名和符号，实现为单向链表
-  * @note - `symbol_table`：符号表，存储变量名和符号
-  * @note - `depth`：符号表的深度
-  * @note - `is_returned`：包含符号表是否已经存在 return 语句，用于判断是否需要生成后续语句
-  * @note - `parent`：指向父级符号表的指针
-  */
-class SymbolTable {
+/**
+ * @brief 标识符驻留表，为一次编译中出现的每个不同的标识符分配一个稠密的整数编号
+ * @note - lexer 对每个标识符 token 调用一次 intern()，整个前端只在这里对标识符名做哈希
+ * @note - 名字指向源文件映射中的字符，不复制
+ * @note - 只由 parser 线程修改；流水线模式下其他线程不能访问
+ */
+class Interner {
 private:
-    unordered_map<string, Symbol> symbol_table;
+    unordered_map<string_view, int> ids;
+    vector<string_view> names;
 public:
-    int depth = 0;
-    bool is_returned = false;
-    SymbolTable* parent = nullptr;
-
-    void create(const string& ident, Symbol symbol);
-    bool exist(const string& ident);
-    Symbol read(const string& ident);
-    void set_parent(SymbolTable* parent);
-    string locate(const string& ident);
-    string assign(const string& ident);
+    int intern(string_view name) {
+        auto [it, inserted] = ids.try_emplace(name, (int)names.size());
+        if (inserted) {
+            names.push_back(name);
+        }
+        return it->second;
+    }
+    string_view name(int id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+};
+
+/**
+ * @brief 标识符 token 的值，包含源文件中的文本与驻留编号
+ */
+struct IdentRef {
+    StringRef text;
+    int id;
+};
+
+/**
+ * @brief 名字绑定，标识一个常量或变量的存储位置
+ * @note - `scope`：GLOBAL 为全局，LOCAL 为所在函数内，UNBOUND 为未定义
+ * @note - `slot`：在全局或函数的扁平符号数组中的下标，每个定义各占一个槽位
+ */
+struct Binding {
+    enum Scope : int8_t {
+        UNBOUND = -1,
+        GLOBAL,
+        LOCAL
+    };
+    Scope scope = UNBOUND;
+    int slot = -1;
+};
+
+/**
+ * @brief 名字解析器，解析完成后遍历一次 AST，把每个定义和使用绑定到槽位
+ * @note - `bindings`：以驻留编号为下标，保存每个标识符当前可见的绑定，查找不随作用域嵌套深度变化
+ * @note - `undo`：被遮蔽的旧绑定，离开作用域时按相反顺序恢复
+ * @note - `marks`：每层作用域进入时 undo 的长度，为空时处于全局作用域
+ * @note - `undefined`：使用了但没有定义的标识符，由编译上下文报告
+ * @note - 绑定结果保存在 AST 节点中，生成 IR 时直接按槽位读写，不再按名字查找
+ */
+class Binder {
+private:
+    vector<Binding> bindings;
+    vector<pair<int, Binding>> undo;
+    vector<size_t> marks;
+    int global_slots = 0;
+    int local_slots = 0;
+public:
+    // 统计信息，为空时不统计
+    Stats* stats = nullptr;
+    vector<int> undefined;
+
+    void enter_scope();
+    void exit_scope();
+    void enter_function();
+    int exit_function();
+    Binding define(int ident);
+    Binding resolve(int ident);
 };
 
 
@@ -86,6 +141,13 @@ public:
     os << (result.type == Type::REG ? "%" : "") << result.value;
     return os;
   }
+  // 友元函数, 不经过 iostream 直接写入输出缓冲区
+  friend OutputBuffer& operator<<(OutputBuffer& buffer, const Result& result) {
+    if (result.type == Type::REG) {
+      buffer << '%';
+    }
+    return buffer << result.value;
+  }
   // 构造函数
   Result() : type(Type::IMM), value(0) {}
   Result(Type type, int value) : type(type), value(value) {}
@@ -101,7 +163,6 @@ public:
 * @brief 前端全局信息管理器，管理横跨 block 的全局信息
 * @note - `is_global`：当前是否为全局，用于控制 Decl 语句的生成
 * @note - `short_circuit_count`：短路求值的计数，用于生成短路求值的标签
-* @note - `is_symbol_allocated`：是否已经存在过分配某变量的指令，避免重复 alloc 指令
 * @note - `temp_count`：临时变量分配计数，用于生成临时变量,SSA 静态单赋值使用
 */
 class EnvironmentManager {
@@ -110,8 +171,6 @@ public:
   bool is_global = true;
   // 短路求值的计数，用于生成短路求值的标签
   int short_circuit_count = 0;
-  // 是否已经存在过分配某变量的指令，避免重复 alloc 指令
-  unordered_map<string, bool> is_symbol_allocated;
   // 临时变量分配计数，用于生成临时变量
   int temp_count = 0;
 
@@ -127,10 +186,163 @@ public:
   int get_temp_count();
 };
 
-extern EnvironmentManager environment_manager;
-
 /**
  * @brief 一些宏定义，用于快速创建 SSA 寄存器
+ * @note 使用当前作用域中的编译上下文 ctx
+ */
+#define NEW_REG_ (STAT_(ctx.stats, temps), REG_(ctx.environment_manager.temp_count++))
+#define CUR_REG_ REG_(ctx.environment_manager.temp_count - 1)
+// 表达式在编译期求值得到的常量结果
+#define FOLD_(value) (STAT_(ctx.stats, folded), IMM_(value))
+
+/**
+ * @brief AST 哈希计算器，用于编译缓存
+ * @note - 同时计算两个不同参数的 64 位 FNV-1a 哈希，合并为 128 位
+ * @note - `globals`：哈希过程中遇到的被引用的全局常量的编号与绑定，用于加入其值
+ */
+class AstHasher {
+public:
+    uint64_t h1 = 0xcbf29ce484222325ull;
+    uint64_t h2 = 0x84222325cbf29ce4ull;
+    vector<pair<int, Binding>> globals;
+    // 标识符驻留表，用于以名字而不是编号计算哈希，使哈希不依赖于标识符出现的顺序
+    const Interner* interner = nullptr;
+
+    void add(const void* data, size_t len) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < len; ++i) {
+            h1 = (h1 ^ bytes[i]) * 0x100000001b3ull;
+            h2 = (h2 ^ bytes[i]) * 0x00000100000001b3ull + 0x9e3779b97f4a7c15ull;
+        }
+    }
+    void add(int value) {
+        add(&value, sizeof(value));
+    }
+    void add(string_view str) {
+        add((int)str.size());
+        add(str.data(), str.size());
+    }
+    void add(const char* str) {
+        add(string_view(str));
+    }
+    // 加入标识符的名字
+    void add_ident(int id) {
+        add(interner->name(id));
+    }
+    string hex() const;
+};
+
+/**
+ * @brief Koopa 类，前端生成 Koopa IR 的统一接口
+ * @note - 各 AST 的 print() 只通过该接口生成指令，不直接操作输出流
+ * @note - KoopaText 输出文本形式的 Koopa IR，KoopaRaw 直接在内存中构建 raw program
  */
-#define NEW_REG_ REG_(environment_manager.temp_count++)
-#define CUR_REG_ REG_(environment_manager.temp_count - 1)
\ No newline at end of file
+class Koopa {
+public:
+    virtual ~Koopa() = default;
+
+    // 函数与基本块
+
+    virtual void _fun(string_view ident, bool is_int) = 0;
+    virtual void _end_fun() = 0;
+    virtual void _label(const string& name) = 0;
+
+    // 运算
+
+    virtual void _binary(koopa_raw_binary_op_t op, const Result& rd, const Result& lhs, const Result& rhs) = 0;
+
+    // 访存
+
+    virtual void _alloc(const string& name) = 0;
+    virtual void _load(const Result& rd, const string& src) = 0;
+    virtual void _store(const Result& value, const string& dest) = 0;
+
+    // 分支与返回
+
+    virtual void _br(const Result& cond, const string& true_label, const string& false_label) = 0;
+    virtual void _jump(const string& label) = 0;
+    virtual void _ret() = 0;
+    virtual void _ret(const Result& value) = 0;
+};
+
+/**
+ * @brief KoopaText 类，将 Koopa IR 以文本形式输出
+ * @note - 指令先格式化到 buffer 中，每个函数结束时整体交给 writer 写出
+ */
+class KoopaText : public Koopa {
+public:
+    // 当前函数的输出缓冲区
+    OutputBuffer buffer;
+    // 输出线程，为空时输出保留在 buffer 中
+    AsyncWriter* writer = nullptr;
+
+    void flush();
+
+    void _fun(string_view ident, bool is_int) override;
+    void _end_fun() override;
+    void _label(const string& name) override;
+    void _binary(koopa_raw_binary_op_t op, const Result& rd, const Result& lhs, const Result& rhs) override;
+    void _alloc(const string& name) override;
+    void _load(const Result& rd, const string& src) override;
+    void _store(const Result& value, const string& dest) override;
+    void _br(const Result& cond, const string& true_label, const string& false_label) override;
+    void _jump(const string& label) override;
+    void _ret() override;
+    void _ret(const Result& value) override;
+};
+
+/**
+ * @brief KoopaRaw 类，直接在内存中构建 koopa_raw_program_t，供后端 visit() 使用
+ * @note - 无需输出 Koopa IR 文本再由 libkoopa 重新解析
+ * @note - raw program 中所有指针指向的内存均归该对象所有，对象析构前 program 有效
+ */
+class KoopaRaw : public Koopa {
+private:
+    // raw program 各部分的存储，deque 保证元素地址不随插入而改变
+    deque<koopa_raw_type_kind_t> types;
+    deque<koopa_raw_function_data_t> funcs;
+    deque<koopa_raw_basic_block_data_t> bbs;
+    deque<koopa_raw_value_data_t> values;
+    deque<vector<const void*>> slices;
+    deque<string> names;
+    // 程序中的所有函数
+    vector<const void*> func_list;
+
+    // 当前函数
+    koopa_raw_function_data_t* cur_func = nullptr;
+    // 当前函数的基本块列表
+    vector<const void*>* cur_bbs = nullptr;
+    // 当前基本块的指令列表
+    vector<const void*>* cur_insts = nullptr;
+    // 基本块名到基本块及其指令列表的映射，基本块可能在定义前被 br/jump 引用
+    unordered_map<string, pair<koopa_raw_basic_block_data_t*, vector<const void*>*>> bb_table;
+    // alloc 指令名到指令的映射
+    unordered_map<string, koopa_raw_value_t> symbol_table;
+    // 临时寄存器编号到指令的映射
+    vector<koopa_raw_value_t> regs;
+
+    static koopa_raw_type_t type_i32();
+    static koopa_raw_type_t type_unit();
+    static koopa_raw_type_t type_ptr_i32();
+    const char* new_name(const string& name);
+    koopa_raw_slice_t new_slice(vector<const void*>* items, koopa_raw_slice_item_kind_t kind);
+    koopa_raw_value_data_t* new_value(koopa_raw_type_t ty, koopa_raw_value_tag_t tag);
+    koopa_raw_value_t value_of(const Result& result);
+    void define(const Result& rd, koopa_raw_value_data_t* value);
+    koopa_raw_basic_block_t block_of(const string& name);
+public:
+    void _fun(string_view ident, bool is_int) override;
+    void _end_fun() override;
+    void _label(const string& name) override;
+    void _binary(koopa_raw_binary_op_t op, const Result& rd, const Result& lhs, const Result& rhs) override;
+    void _alloc(const string& name) override;
+    void _load(const Result& rd, const string& src) override;
+    void _store(const Result& value, const string& dest) override;
+    void _br(const Result& cond, const string& true_label, const string& false_label) override;
+    void _jump(const string& label) override;
+    void _ret() override;
+    void _ret(const Result& value) override;
+
+    koopa_raw_program_t program();
+    koopa_raw_function_t last_function();
+};
\ No newline at end of file
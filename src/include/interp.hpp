@@ -0,0 +1,72 @@
+#pragma once
+
+#include "koopa.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "include/other_utils.hpp"
+
+using namespace std;
+
+/**
+ * @brief Koopa IR 解释器，直接遍历 koopa_raw_* 结构执行程序
+ * @note - 与 visit() 遍历相同的 raw program，不经过汇编，可用于快速衡量优化效果
+ * @note - 内存以 32 位字为单位，指针为字下标；局部 alloc 在函数返回时释放
+ * @note - 统计每个基本块的执行次数与每种指令的执行次数，可用于块布局与内联的决策
+ * @note - 未定义函数体的函数按 SysY 运行时库处理，如 getint / putint
+ * @note - 程序的输出写到 output，为空时写到 stdout；程序的输入从 input 读取，为空时从 stdin 读取；出错的原因保存在 error 中
+ * @note - 每层 Koopa 调用对应一层本机递归，调用深度超过 max_call_depth 时报错，避免本机栈溢出
+ */
+class KoopaInterpreter {
+private:
+    // 一次函数调用的栈帧
+    struct Frame {
+        // 指令与基本块参数的值
+        unordered_map<koopa_raw_value_t, int32_t> values;
+        // 函数参数
+        vector<int32_t> args;
+    };
+
+    koopa_raw_program_t program;
+    vector<int32_t> memory;
+    unordered_map<koopa_raw_value_t, int32_t> globals;
+    // 基本块执行次数
+    unordered_map<koopa_raw_basic_block_t, uint64_t> block_counts;
+    // 各种指令的执行次数，下标为 koopa_raw_value_tag_t
+    uint64_t kind_counts[KOOPA_RVT_RETURN + 1] = {};
+    // 各种二元运算的执行次数，下标为 koopa_raw_binary_op_t
+    uint64_t binary_counts[KOOPA_RBO_SAR + 1] = {};
+    uint64_t instructions = 0;
+    int32_t exit_code = 0;
+    // 当前的调用深度
+    size_t depth = 0;
+    // input 中下一个未读的字符
+    size_t input_pos = 0;
+
+    static size_t type_size(koopa_raw_type_t type);
+    int32_t allocate(koopa_raw_type_t type);
+    void initialize(int32_t address, koopa_raw_value_t init);
+    int32_t& at(int32_t address);
+    int32_t eval(koopa_raw_value_t value, Frame& frame);
+    int32_t call(koopa_raw_function_t func, vector<int32_t>&& args);
+    int32_t call_library(const string& name, const vector<int32_t>& args);
+    void put(const string& text);
+    int get_char();
+    bool get_int(int32_t& value);
+    void pass_args(koopa_raw_basic_block_t target, const koopa_raw_slice_t& args, Frame& frame);
+public:
+    // 调用深度上限，-O0 下每层约占 600 字节本机栈，远小于默认的 8 MiB
+    static constexpr size_t max_call_depth = 10000;
+    // 程序的输出，为空时写到 stdout
+    string* output = nullptr;
+    // 程序的输入，为空时从 stdin 读取
+    const string* input = nullptr;
+    // run() 失败时的原因
+    string error;
+
+    explicit KoopaInterpreter(const koopa_raw_program_t& program) : program(program) {}
+
+    bool run(const string& entry = "main");
+    void print_profile(OutputBuffer& buffer) const;
+};
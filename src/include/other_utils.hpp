@@ -1 +1,471 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <map>
+#include <new>
+
+using namespace std;
+
+/**
+ * @brief 输出缓冲区，用于在内存中拼接汇编或 IR 文本
+ * @note - 可自动增长，整数使用 to_chars 格式化，不经过 iostream
+ * @note - 不会自动写出，由使用者决定何时交给 AsyncWriter
+ */
+class OutputBuffer {
+public:
+    string buffer;
+
+    OutputBuffer& operator<<(string_view str) {
+        buffer.append(str.data(), str.size());
+        return *this;
+    }
+    OutputBuffer& operator<<(char ch) {
+        buffer.push_back(ch);
+        return *this;
+    }
+    OutputBuffer& operator<<(int value) {
+        char digits[16];
+        auto [end, ec] = to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, end - digits);
+        return *this;
+    }
+
+    size_t size() const { return buffer.size(); }
+    bool empty() const { return buffer.empty(); }
+    void clear() { buffer.clear(); }
+};
+
+/**
+ * @brief 后台写出线程，将写满的缓冲区写入文件
+ * @note - submit() 只把缓冲区移入队列，真正的 write 在后台线程中完成
+ * @note - background 为 false 时不启动线程，submit() 直接写出
+ * @note - close() 会等待所有缓冲区写出后再关闭文件，并返回写出过程中的第一个错误
+ */
+class TimeReport;
+
+class AsyncWriter {
+private:
+    int fd = -1;
+    bool background = true;
+    bool closing = false;
+    deque<string> queue;
+    mutex queue_mutex;
+    condition_variable queue_cv;
+    thread worker;
+    // 第一个写出错误的 errno，0 表示没有错误
+    int error = 0;
+
+    void run();
+    void write_all(const string& buffer);
+public:
+    // 计时报告，不为空时统计写出耗时
+    TimeReport* timer = nullptr;
+
+    ~AsyncWriter();
+
+    bool open(const char* path, bool background = true);
+    void submit(string&& buffer);
+    int close();
+    bool is_open() const { return fd >= 0; }
+};
+
+/**
+ * @brief 编译计时报告，类似 -ftime-report
+ * @note - 按阶段累计耗时，阶段按第一次出现的顺序输出
+ * @note - 同时记录每个计时区间，可导出为 Chrome trace-event JSON，在 chrome://tracing 或 Perfetto 中查看
+ * @note - 各阶段可能在不同线程中重叠执行，累计耗时之和可能超过总耗时
+ * @note - 线程安全
+ */
+class TimeReport {
+public:
+    using clock = chrono::steady_clock;
+private:
+    struct Span {
+        string name;
+        string category;
+        int64_t start;
+        int64_t duration;
+        size_t tid;
+    };
+    clock::time_point origin = clock::now();
+    vector<pair<string, int64_t>> phases;
+    vector<Span> spans;
+    mutex report_mutex;
+public:
+    // 是否记录 trace 区间
+    bool trace = false;
+
+    int64_t elapsed(clock::time_point time) const;
+    void add(const string& phase, const string& name, clock::time_point start, clock::time_point end);
+    void print(FILE* file);
+    bool write_trace(const char* path);
+};
+
+/**
+ * @brief 计时区间，构造时开始计时，析构时记入 TimeReport
+ * @note - report 为空时不做任何事
+ * @note - name 为空时计入阶段累计耗时；否则只记录一个名为 name 的 trace 区间，如单个函数
+ */
+class TimeScope {
+private:
+    TimeReport* report;
+    string phase;
+    string name;
+    TimeReport::clock::time_point start;
+public:
+    TimeScope(TimeReport* report, const char* phase, string_view name = {})
+        : report(report) {
+        if (report != nullptr) {
+            this->phase = phase;
+            this->name = name;
+            start = TimeReport::clock::now();
+        }
+    }
+    TimeScope(const TimeScope&) = delete;
+    TimeScope& operator=(const TimeScope&) = delete;
+    ~TimeScope() {
+        if (report != nullptr) {
+            report->add(phase, name, start, TimeReport::clock::now());
+        }
+    }
+};
+
+/**
+ * @brief 内存报告，按阶段记录堆内存与常驻内存的高水位
+ * @note - 堆内存由替换的全局 operator new / delete 统计，只包含本程序通过 new 分配的内存，不含 libkoopa 等通过 malloc 分配的内存；
+ * @note   只统计创建 MemoryReport 之后分配的内存，之前分配的内存释放时不计入
+ * @note - 统计是进程级的，包含所有线程的分配，同时只能存在一个 MemoryReport；
+ * @note   因此只有单次编译支持 -mem-report，-batch 与 -server 中多个编译同时进行，不支持
+ * @note - 常驻内存读取 /proc/self/status 的 VmRSS 与 VmHWM，阶段开始时写 /proc/self/clear_refs 重置 VmHWM，包含所有内存
+ * @note - 同名阶段合并为一条记录：堆内存增减为各次之和，终点取最后一次结束，高水位取最大值，用于逐函数执行的阶段
+ * @note - 阶段可在不同线程中重叠执行（如流水线模式），高水位只在没有其他阶段进行时重置，因此包含同时进行的其他阶段
+ */
+class MemoryReport {
+private:
+    struct Phase {
+        string name;
+        // 阶段开始、结束时与阶段内最大的堆内存字节数
+        int64_t heap_begin, heap_end, heap_peak;
+        // 阶段开始、结束时与阶段内最大的常驻内存 KiB 数
+        int64_t rss_begin, rss_end, rss_peak;
+    };
+    vector<Phase> phases;
+    // 正在进行的阶段数
+    int active = 0;
+    mutex report_mutex;
+public:
+    // 阶段开始时的堆内存字节数与常驻内存 KiB 数
+    struct Mark {
+        int64_t heap, rss;
+    };
+
+    MemoryReport();
+    ~MemoryReport();
+
+    Mark begin();
+    void end(const string& phase, const Mark& mark);
+    void print(FILE* file) const;
+    bool write_json(const char* path) const;
+};
+
+/**
+ * @brief 内存统计区间，构造时开始一个阶段，析构时结束该阶段
+ * @note report 为空时不做任何事
+ */
+class MemoryScope {
+private:
+    MemoryReport* report;
+    const char* phase;
+    MemoryReport::Mark mark{};
+public:
+    MemoryScope(MemoryReport* report, const char* phase) : report(report), phase(phase) {
+        if (report != nullptr) {
+            mark = report->begin();
+        }
+    }
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+    ~MemoryScope() {
+        if (report != nullptr) {
+            report->end(phase, mark);
+        }
+    }
+};
+
+/**
+ * @brief 编译统计信息，-stats 模式下输出
+ * @note - 各计数器由前端和后端在热点路径上累加，持有者的 stats 指针为空时不统计
+ * @note - 不同线程只累加各自阶段的计数器；并行生成汇编时每个线程使用独立的 Stats，结束后合并
+ */
+class Stats {
+public:
+    // lexer 返回的 token 数
+    size_t tokens = 0;
+    // 各类型 AST 节点的分配数
+    map<string, size_t> ast_nodes;
+    // Binder::resolve 的调用次数
+    size_t symbol_lookups = 0;
+    // NEW_REG_ 分配的临时寄存器数
+    size_t temps = 0;
+    // 在编译期求值为 IMM_ 的表达式数
+    size_t folded = 0;
+    // 生成的短路求值块数
+    size_t short_circuits = 0;
+    // 各 Riscv::_* 方法生成的指令数
+    map<string, size_t> riscv_insts;
+
+    void merge(const Stats& other);
+    void print(FILE* file) const;
+};
+
+/**
+ * @brief 统计计数器加一，stats 为空时不做任何事
+ * @note 是一个表达式，可以用在逗号表达式中
+ */
+#define STAT_(stats, counter) ((stats) != nullptr ? (void)++(stats)->counter : (void)0)
+
+/**
+ * @brief 字符串切片，指向其他缓冲区中的一段字符，不持有内存
+ * @note - 可以放入 bison 的 %union 中，用于 token 的零拷贝传递
+ */
+struct StringRef {
+    const char* data;
+    size_t len;
+
+    operator string_view() const { return string_view(data, len); }
+};
+
+/**
+ * @brief 单调分配器 (bump-pointer arena)，用于 AST 节点与 parser 的临时列表
+ * @note - 在固定大小的块中顺序分配，块用尽时再申请新块，已分配对象的地址不会改变
+ * @note - 不调用对象的析构函数，arena 析构时一次释放所有块，放入其中的对象不能持有需要析构的资源
+ * @note - 只能由一个线程分配；其他线程读取已分配完成的对象是安全的，流水线模式下即是如此
+ */
+class Arena {
+private:
+    // 普通块的大小，超过该大小的分配独占一个块
+    static constexpr size_t block_size = 64 * 1024;
+    vector<unique_ptr<char[]>> blocks;
+    uintptr_t cur = 0;
+    uintptr_t end = 0;
+    // 已分配的字节数，不含对齐填充
+    size_t used = 0;
+
+    void* grow(size_t size, size_t align);
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (cur + align - 1) & ~(uintptr_t)(align - 1);
+        if (cur == 0 || p + size > end) {
+            return grow(size, align);
+        }
+        cur = p + size;
+        used += size;
+        return reinterpret_cast<void*>(p);
+    }
+    // 在 arena 中构造一个对象
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+    }
+    // 分配 n 个元素的数组，元素未初始化
+    template <typename T>
+    T* make_array(size_t n) {
+        return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+    }
+    size_t bytes() const { return used; }
+};
+
+/**
+ * @brief arena 中的连续数组，不持有内存
+ * @note 可以用于范围 for 循环
+ */
+template <typename T>
+struct ArenaSlice {
+    T* items = nullptr;
+    size_t len = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + len; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    T& operator[](size_t index) const { return items[index]; }
+};
+
+/**
+ * @brief parser 构建列表时使用的临时单向链表，节点分配在 arena 中
+ * @note - 规约时逐个 push_back，整个列表规约完成后由 flatten() 复制为 ArenaSlice
+ * @note - 本身也分配在 arena 中，只有一个指针大小，可以放入 bison 的 %union
+ */
+template <typename T>
+class ArenaList {
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+    Node* head = nullptr;
+    Node* tail = nullptr;
+    size_t len = 0;
+public:
+    void push_back(Arena& arena, T value) {
+        auto node = arena.make<Node>(Node{ value, nullptr });
+        if (tail == nullptr) {
+            head = node;
+        }
+        else {
+            tail->next = node;
+        }
+        tail = node;
+        ++len;
+    }
+    size_t size() const { return len; }
+    // 复制为连续数组，可以在开头额外放入一个元素
+    ArenaSlice<T> flatten(Arena& arena, const T* first = nullptr) const {
+        ArenaSlice<T> slice;
+        slice.len = len + (first != nullptr);
+        slice.items = arena.make_array<T>(slice.len);
+        size_t i = 0;
+        if (first != nullptr) {
+            new (&slice.items[i++]) T(*first);
+        }
+        for (auto node = head; node != nullptr; node = node->next) {
+            new (&slice.items[i++]) T(node->value);
+        }
+        return slice;
+    }
+};
+
+/**
+ * @brief 只读映射的源文件
+ * @note - 文件内容通过 mmap 私有映射一次，之后 lexer 直接在映射上扫描
+ * @note - 映射末尾保证有两个 '\0'，满足 flex 的 yy_scan_buffer 要求
+ * @note - 映射为写时复制，flex 在扫描时临时写入的 '\0' 不会影响文件
+ * @note - 无法映射时（如管道）退化为一次性读入内存
+ */
+class MappedFile {
+private:
+    char* base = nullptr;
+    size_t length = 0;
+    size_t mapped_length = 0;
+    string fallback;
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const char* path);
+    void load(string&& text);
+    void close();
+    // 文件内容
+    char* data() const { return base; }
+    // 文件长度，不含末尾的两个 '\0'
+    size_t size() const { return length; }
+    // 交给 yy_scan_buffer 的长度，含末尾的两个 '\0'
+    size_t scan_size() const { return length + 2; }
+};
+
+/**
+ * @brief 固定大小的线程池，支持工作窃取
+ * @note - 每个线程有自己的任务队列，submit() 按轮转方式分配任务
+ * @note - 线程优先从自己队列的头部取任务，空闲时从其他线程队列的尾部窃取
+ * @note - wait() 等待所有已提交的任务完成，线程池可以重复使用
+ */
+class ThreadPool {
+private:
+    struct WorkQueue {
+        mutex queue_mutex;
+        deque<function<void()>> tasks;
+    };
+    vector<unique_ptr<WorkQueue>> queues;
+    vector<thread> workers;
+    // 队列中尚未被取走的任务数
+    atomic<size_t> queued{0};
+    // 已提交但尚未完成的任务数
+    atomic<size_t> pending{0};
+    atomic<size_t> next_queue{0};
+    bool stopping = false;
+    mutex state_mutex;
+    condition_variable work_cv;
+    condition_variable done_cv;
+
+    bool try_pop(size_t id, function<void()>& task);
+    void run(size_t id);
+public:
+    explicit ThreadPool(size_t threads = thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    void submit(function<void()> task);
+    void wait();
+    size_t size() const { return workers.size(); }
+};
+
+/**
+ * @brief 有界阻塞队列，用于流水线各阶段之间传递数据
+ * @note - push() 在队列满时阻塞，pop() 在队列空时阻塞
+ * @note - close() 之后 push() 无效，pop() 取完剩余元素后返回 false
+ */
+template <typename T>
+class BoundedQueue {
+private:
+    deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    mutex queue_mutex;
+    condition_variable not_full;
+    condition_variable not_empty;
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+
+    void push(T item) {
+        unique_lock<mutex> lock(queue_mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return;
+        }
+        items.emplace_back(move(item));
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    bool pop(T& item) {
+        unique_lock<mutex> lock(queue_mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+};
\ No newline at end of file
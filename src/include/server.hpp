@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * @brief 编译服务的通信协议，服务端与客户端共用
+ * @note - 请求：依次为 模式、输入类型、输入、输出路径、程序输入 五个字段
+ * @note - 输入类型为 "path" 时输入为源文件路径，为 "source" 时输入为源程序文本
+ * @note - 程序输入是 -interp 模式下 getint 等函数读取的内容，服务端不读取自己的 stdin
+ * @note - 响应：状态码（0 表示成功）、诊断信息、程序输出三个字段，诊断信息由客户端写到 stderr，
+ * @note   -interp 模式下程序的输出由客户端写到 stdout
+ * @note - 每个字段编码为 4 字节小端长度加上内容，状态码编码为十进制字符串
+ * @note - 字段长度超过 SERVER_MAX_FIELD 时视为无效请求，直接断开连接
+ */
+#define SERVER_SOCKET_NAME "sysy-compiler.sock"
+#define SERVER_SOCKET_ENV "SYSY_COMPILER_SOCKET"
+#define SERVER_MAX_FIELD (256u << 20)
+
+/**
+ * @brief 服务的套接字路径，服务端与客户端共用
+ * @note 依次取环境变量 SYSY_COMPILER_SOCKET、$XDG_RUNTIME_DIR/sysy-compiler.sock，
+ * @note 都未设置时为 /tmp/sysy-compiler-<uid>.sock，不同用户的服务互不冲突
+ */
+inline string server_socket_path() {
+    if (auto path = getenv(SERVER_SOCKET_ENV)) {
+        return path;
+    }
+    if (auto dir = getenv("XDG_RUNTIME_DIR")) {
+        return string(dir) + "/" SERVER_SOCKET_NAME;
+    }
+    return "/tmp/sysy-compiler-" + to_string(getuid()) + ".sock";
+}
+
+/**
+ * @brief 完整写入 len 字节
+ */
+inline bool write_exact(int fd, const void* data, size_t len) {
+    auto ptr = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::write(fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief 完整读取 len 字节
+ */
+inline bool read_exact(int fd, void* data, size_t len) {
+    auto ptr = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = ::read(fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief 写入一个字段
+ */
+inline bool write_field(int fd, const string& field) {
+    uint8_t header[4];
+    uint32_t len = field.size();
+    for (int i = 0; i < 4; ++i) {
+        header[i] = (len >> (8 * i)) & 0xff;
+    }
+    return write_exact(fd, header, 4) && write_exact(fd, field.data(), field.size());
+}
+
+/**
+ * @brief 读取一个字段
+ * @return 是否读取成功，长度超过 SERVER_MAX_FIELD 时失败，不分配内存
+ */
+inline bool read_field(int fd, string& field) {
+    uint8_t header[4];
+    if (!read_exact(fd, header, 4)) {
+        return false;
+    }
+    uint32_t len = 0;
+    for (int i = 0; i < 4; ++i) {
+        len |= uint32_t(header[i]) << (8 * i);
+    }
+    if (len > SERVER_MAX_FIELD) {
+        return false;
+    }
+    field.resize(len);
+    return read_exact(fd, field.data(), len);
+}
+
+int run_server(int argc, const char* argv[]);
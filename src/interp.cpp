@@ -0,0 +1,415 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include "include/interp.hpp"
+#include "include/backend_utils.hpp"
+
+// 各种二元运算的名字，下标为 koopa_raw_binary_op_t
+static const char* binary_name[] = {
+    "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul",
+    "div", "mod", "and", "or", "xor", "shl", "shr", "sar",
+};
+
+/**
+ * @brief 计算类型占用的字数
+ */
+size_t KoopaInterpreter::type_size(koopa_raw_type_t type) {
+    switch (type->tag) {
+    case KOOPA_RTT_ARRAY:
+        return type->data.array.len * type_size(type->data.array.base);
+    case KOOPA_RTT_UNIT:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief 分配一段内存
+ * @param[in] type 分配的对象类型
+ * @return 首地址
+ */
+int32_t KoopaInterpreter::allocate(koopa_raw_type_t type) {
+    int32_t address = (int32_t)memory.size();
+    memory.resize(memory.size() + type_size(type), 0);
+    return address;
+}
+
+/**
+ * @brief 用全局变量的初始值初始化内存
+ * @param[in] address 首地址
+ * @param[in] init 初始值，整数、零初始化或聚合
+ */
+void KoopaInterpreter::initialize(int32_t address, koopa_raw_value_t init) {
+    switch (init->kind.tag) {
+    case KOOPA_RVT_INTEGER:
+        at(address) = init->kind.data.integer.value;
+        break;
+    case KOOPA_RVT_AGGREGATE: {
+        auto& elems = init->kind.data.aggregate.elems;
+        for (size_t i = 0; i < elems.len; ++i) {
+            auto elem = reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]);
+            initialize(address, elem);
+            address += (int32_t)type_size(elem->ty);
+        }
+        break;
+    }
+    default:
+        // zeroinit 与 undef 保持为 0
+        break;
+    }
+}
+
+/**
+ * @brief 访问内存中的一个字
+ */
+int32_t& KoopaInterpreter::at(int32_t address) {
+    if (address < 0 || (size_t)address >= memory.size()) {
+        throw runtime_error("invalid memory access at " + to_string(address));
+    }
+    return memory[address];
+}
+
+/**
+ * @brief 求值一个操作数
+ * @param[in] value 操作数
+ * @param[in] frame 当前栈帧
+ */
+int32_t KoopaInterpreter::eval(koopa_raw_value_t value, Frame& frame) {
+    switch (value->kind.tag) {
+    case KOOPA_RVT_INTEGER:
+        return value->kind.data.integer.value;
+    case KOOPA_RVT_ZERO_INIT:
+    case KOOPA_RVT_UNDEF:
+        return 0;
+    case KOOPA_RVT_FUNC_ARG_REF:
+        return frame.args.at(value->kind.data.func_arg_ref.index);
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        return globals.at(value);
+    default: {
+        auto it = frame.values.find(value);
+        if (it == frame.values.end()) {
+            throw runtime_error("use of undefined value");
+        }
+        return it->second;
+    }
+    }
+}
+
+/**
+ * @brief 跳转时将实参传给目标基本块的参数
+ */
+void KoopaInterpreter::pass_args(koopa_raw_basic_block_t target, const koopa_raw_slice_t& args, Frame& frame) {
+    vector<int32_t> values;
+    for (size_t i = 0; i < args.len; ++i) {
+        values.push_back(eval(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]), frame));
+    }
+    for (size_t i = 0; i < target->params.len && i < values.size(); ++i) {
+        frame.values[reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i])] = values[i];
+    }
+}
+
+/**
+ * @brief 调用函数
+ * @param[in] func 函数
+ * @param[in] args 实参
+ * @return 返回值，无返回值时为 0
+ */
+int32_t KoopaInterpreter::call(koopa_raw_function_t func, vector<int32_t>&& args) {
+    if (func->bbs.len == 0) {
+        return call_library(func->name + 1, args);
+    }
+    if (++depth > max_call_depth) {
+        throw runtime_error("call depth limit exceeded");
+    }
+    Frame frame;
+    frame.args = move(args);
+    // 函数返回时释放局部 alloc
+    size_t memory_top = memory.size();
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+    while (true) {
+        block_counts[bb]++;
+        koopa_raw_basic_block_t next = nullptr;
+        for (size_t i = 0; i < bb->insts.len && next == nullptr; ++i) {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+            auto& kind = inst->kind;
+            instructions++;
+            kind_counts[kind.tag]++;
+            switch (kind.tag) {
+            case KOOPA_RVT_ALLOC: {
+                // 循环中再次执行同一条 alloc 时复用已分配的空间，否则内存随迭代次数增长
+                auto [it, inserted] = frame.values.try_emplace(inst, 0);
+                if (inserted) {
+                    it->second = allocate(inst->ty->data.pointer.base);
+                }
+                break;
+            }
+            case KOOPA_RVT_LOAD:
+                frame.values[inst] = at(eval(kind.data.load.src, frame));
+                break;
+            case KOOPA_RVT_STORE:
+                at(eval(kind.data.store.dest, frame)) = eval(kind.data.store.value, frame);
+                break;
+            case KOOPA_RVT_GET_PTR: {
+                auto src = eval(kind.data.get_ptr.src, frame);
+                auto index = eval(kind.data.get_ptr.index, frame);
+                auto size = type_size(kind.data.get_ptr.src->ty->data.pointer.base);
+                frame.values[inst] = src + index * (int32_t)size;
+                break;
+            }
+            case KOOPA_RVT_GET_ELEM_PTR: {
+                auto src = eval(kind.data.get_elem_ptr.src, frame);
+                auto index = eval(kind.data.get_elem_ptr.index, frame);
+                auto array = kind.data.get_elem_ptr.src->ty->data.pointer.base;
+                frame.values[inst] = src + index * (int32_t)type_size(array->data.array.base);
+                break;
+            }
+            case KOOPA_RVT_BINARY: {
+                auto& binary = kind.data.binary;
+                binary_counts[binary.op]++;
+                auto lhs = eval(binary.lhs, frame);
+                auto rhs = eval(binary.rhs, frame);
+                auto ul = (uint32_t)lhs;
+                auto ur = (uint32_t)rhs;
+                int32_t result = 0;
+                switch (binary.op) {
+                case KOOPA_RBO_NOT_EQ: result = lhs != rhs; break;
+                case KOOPA_RBO_EQ: result = lhs == rhs; break;
+                case KOOPA_RBO_GT: result = lhs > rhs; break;
+                case KOOPA_RBO_LT: result = lhs < rhs; break;
+                case KOOPA_RBO_GE: result = lhs >= rhs; break;
+                case KOOPA_RBO_LE: result = lhs <= rhs; break;
+                case KOOPA_RBO_ADD: result = (int32_t)(ul + ur); break;
+                case KOOPA_RBO_SUB: result = (int32_t)(ul - ur); break;
+                case KOOPA_RBO_MUL: result = (int32_t)(ul * ur); break;
+                case KOOPA_RBO_DIV:
+                    if (rhs == 0) {
+                        throw runtime_error("division by zero");
+                    }
+                    result = (lhs == INT32_MIN && rhs == -1) ? lhs : lhs / rhs;
+                    break;
+                case KOOPA_RBO_MOD:
+                    if (rhs == 0) {
+                        throw runtime_error("division by zero");
+                    }
+                    result = (lhs == INT32_MIN && rhs == -1) ? 0 : lhs % rhs;
+                    break;
+                case KOOPA_RBO_AND: result = lhs & rhs; break;
+                case KOOPA_RBO_OR: result = lhs | rhs; break;
+                case KOOPA_RBO_XOR: result = lhs ^ rhs; break;
+                case KOOPA_RBO_SHL: result = (int32_t)(ul << (ur & 31)); break;
+                case KOOPA_RBO_SHR: result = (int32_t)(ul >> (ur & 31)); break;
+                case KOOPA_RBO_SAR: result = lhs >> (ur & 31); break;
+                }
+                frame.values[inst] = result;
+                break;
+            }
+            case KOOPA_RVT_BRANCH: {
+                auto& branch = kind.data.branch;
+                if (eval(branch.cond, frame) != 0) {
+                    pass_args(branch.true_bb, branch.true_args, frame);
+                    next = branch.true_bb;
+                }
+                else {
+                    pass_args(branch.false_bb, branch.false_args, frame);
+                    next = branch.false_bb;
+                }
+                break;
+            }
+            case KOOPA_RVT_JUMP:
+                pass_args(kind.data.jump.target, kind.data.jump.args, frame);
+                next = kind.data.jump.target;
+                break;
+            case KOOPA_RVT_CALL: {
+                vector<int32_t> call_args;
+                auto& args = kind.data.call.args;
+                for (size_t j = 0; j < args.len; ++j) {
+                    call_args.push_back(eval(reinterpret_cast<koopa_raw_value_t>(args.buffer[j]), frame));
+                }
+                frame.values[inst] = call(kind.data.call.callee, move(call_args));
+                break;
+            }
+            case KOOPA_RVT_RETURN: {
+                int32_t result = kind.data.ret.value != nullptr ? eval(kind.data.ret.value, frame) : 0;
+                memory.resize(memory_top);
+                depth--;
+                return result;
+            }
+            default:
+                throw runtime_error(string("unsupported instruction ") + value_kind_name(kind.tag));
+            }
+        }
+        if (next == nullptr) {
+            throw runtime_error(string("basic block ") + (bb->name ? bb->name : "?") + " has no terminator");
+        }
+        bb = next;
+    }
+}
+
+/**
+ * @brief 执行 SysY 运行时库函数
+ * @param[in] name 函数名，不含 @
+ * @param[in] args 实参
+ */
+int32_t KoopaInterpreter::call_library(const string& name, const vector<int32_t>& args) {
+    int32_t value = 0;
+    if (name == "getint") {
+        if (!get_int(value)) {
+            value = 0;
+        }
+        return value;
+    }
+    if (name == "getch") {
+        return get_char();
+    }
+    if (name == "getarray") {
+        int32_t n = 0;
+        if (!get_int(n)) {
+            n = 0;
+        }
+        for (int32_t i = 0; i < n; ++i) {
+            if (!get_int(value)) {
+                value = 0;
+            }
+            at(args.at(0) + i) = value;
+        }
+        return n;
+    }
+    if (name == "putint") {
+        put(to_string(args.at(0)));
+        return 0;
+    }
+    if (name == "putch") {
+        put(string(1, (char)args.at(0)));
+        return 0;
+    }
+    if (name == "putarray") {
+        string text = to_string(args.at(0)) + ":";
+        for (int32_t i = 0; i < args.at(0); ++i) {
+            text += " " + to_string(at(args.at(1) + i));
+        }
+        put(text + "\n");
+        return 0;
+    }
+    if (name == "starttime" || name == "stoptime") {
+        return 0;
+    }
+    throw runtime_error("undefined function " + name);
+}
+
+/**
+ * @brief 输出程序的一段输出
+ */
+void KoopaInterpreter::put(const string& text) {
+    if (output != nullptr) {
+        output->append(text);
+    }
+    else {
+        fwrite(text.data(), 1, text.size(), stdout);
+    }
+}
+
+/**
+ * @brief 读入程序输入的一个字符
+ * @return 字符，输入结束时为 EOF
+ */
+int KoopaInterpreter::get_char() {
+    if (input == nullptr) {
+        return getchar();
+    }
+    return input_pos < input->size() ? (unsigned char)(*input)[input_pos++] : EOF;
+}
+
+/**
+ * @brief 读入程序输入的一个十进制整数，跳过前导空白
+ * @param[out] value 读到的整数
+ * @return 是否读到整数
+ */
+bool KoopaInterpreter::get_int(int32_t& value) {
+    if (input == nullptr) {
+        return scanf("%d", &value) == 1;
+    }
+    while (input_pos < input->size() && isspace((unsigned char)(*input)[input_pos])) {
+        input_pos++;
+    }
+    // string 以 '\0' 结尾，strtol 不会越界
+    const char* begin = input->c_str() + input_pos;
+    char* end;
+    long number = strtol(begin, &end, 10);
+    if (end == begin) {
+        return false;
+    }
+    input_pos += end - begin;
+    value = (int32_t)number;
+    return true;
+}
+
+/**
+ * @brief 初始化全局变量并执行入口函数
+ * @param[in] entry 入口函数名，不含 @
+ * @return 是否正常结束
+ * @note 出错时原因保存在 error 中
+ */
+bool KoopaInterpreter::run(const string& entry) {
+    try {
+        for (size_t i = 0; i < program.values.len; ++i) {
+            auto value = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]);
+            if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+                auto address = allocate(value->ty->data.pointer.base);
+                globals[value] = address;
+                initialize(address, value->kind.data.global_alloc.init);
+            }
+        }
+        for (size_t i = 0; i < program.funcs.len; ++i) {
+            auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+            if (entry == func->name + 1) {
+                exit_code = call(func, {});
+                fflush(stdout);
+                return true;
+            }
+        }
+        error = "function " + entry + " not found";
+    }
+    catch (const exception& e) {
+        // 越界的实参下标等也作为执行错误报告
+        fflush(stdout);
+        error = e.what();
+    }
+    return false;
+}
+
+/**
+ * @brief 输出执行统计
+ * @param[out] buffer 输出缓冲区
+ * @note 依次输出返回值、总指令数、各函数各基本块的执行次数与各种指令的执行次数
+ */
+void KoopaInterpreter::print_profile(OutputBuffer& buffer) const {
+    buffer << "exit code: " << exit_code << '\n';
+    buffer << "instructions: " << to_string(instructions) << '\n';
+    buffer << '\n' << "basic blocks:" << '\n';
+    for (size_t i = 0; i < program.funcs.len; ++i) {
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        if (func->bbs.len == 0) {
+            continue;
+        }
+        buffer << func->name << ':' << '\n';
+        for (size_t j = 0; j < func->bbs.len; ++j) {
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+            auto it = block_counts.find(bb);
+            auto count = it == block_counts.end() ? 0 : it->second;
+            buffer << "  " << (bb->name ? bb->name : "%?") << ": " << to_string(count) << '\n';
+        }
+    }
+    buffer << '\n' << "instruction kinds:" << '\n';
+    for (size_t i = 0; i <= KOOPA_RVT_RETURN; ++i) {
+        if (kind_counts[i] != 0) {
+            buffer << "  " << value_kind_name((koopa_raw_value_tag_t)i) << ": " << to_string(kind_counts[i]) << '\n';
+        }
+    }
+    for (size_t i = 0; i <= KOOPA_RBO_SAR; ++i) {
+        if (binary_counts[i] != 0) {
+            buffer << "  binary " << binary_name[i] << ": " << to_string(binary_counts[i]) << '\n';
+        }
+    }
+}
@@ -1,59 +1,118 @@
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <string>
-#include "include/ast.hpp"
-#include "include/asm.hpp"
+#include "include/context.hpp"
+#include "include/batch.hpp"
+#include "include/server.hpp"
 
 using namespace std;
 
-// 声明 lexer 的输入, 以及 parser 函数
-// 注意, 这两个函数是由 flex/bison 生成的, 不要手动修改
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
-
-string mode = "-debug";
-
-ofstream koopa_ofs;
-ofstream riscv_ofs;
-
 int main(int argc, const char *argv[]) {
+  // 批量模式: compiler -batch 模式 [-j 线程数] [-f 清单文件] [输入文件 输出文件]...
+  if (argc >= 2 && string(argv[1]) == "-batch") {
+    return run_batch(argc, argv);
+  }
+  // 服务模式: compiler -server [套接字路径] [-j 线程数]
+  if (argc >= 2 && string(argv[1]) == "-server") {
+    return run_server(argc, argv);
+  }
+
   // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-  // compiler 模式 输入文件 -o 输出文件
-  assert(argc == 5);
-  mode = argv[1];
+  // 解释执行模式: compiler -interp 输入文件 -o 执行统计文件, 程序的输出写到 stdout
+  // 输入文件以 .koopa 结尾时只运行后端: compiler -riscv 输入.koopa -o 输出文件
+  // compiler 模式 输入文件 -o 输出文件 [-j 线程数] [-pipeline] [-cache 缓存目录]
+  //                           [-ftime-report] [-ftime-trace trace.json] [-stats]
+  //                           [-mem-report] [-mem-report-json report.json]
+  //                           [-finstrument-cycles]
+  // -finstrument-cycles 在每个函数的入口与出口读取 rdcycle / rdinstret, main 返回前
+  // 向 stdout 输出每个函数一行 "函数名 调用次数 周期数 指令数"
+  assert(argc >= 5);
+  auto mode = argv[1];
   auto input = argv[2];
   auto output = argv[4];
 
-  // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
-  yyin = fopen(input, "r");
-  assert(yyin);
-
-  // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
-  unique_ptr<BaseAST> ast;
-  auto ret = yyparse(ast);
-  assert(!ret);
-
-  if (mode == string("-koopa")) { // 输出koopa IR
-    // 打开输出文件, 并且指定 AST 在输出的时候将内容打印到这个文件中
-    koopa_ofs.open(output);
-    ast->print();
-    koopa_ofs.close();
-  } 
-  else if (mode == string("-riscv")) {
-    koopa_ofs.open("ir.koopa");
-		ast->print();
-		koopa_ofs.close();
-
-    char koopa_ir[1 << 20];
-		ifstream koopa_ifs("ir.koopa");
-		koopa_ifs.read(koopa_ir, sizeof(koopa_ir));
-		riscv_ofs.open(output);
-		parse_riscv(koopa_ir);
-		riscv_ofs.close();
+  // 一次编译的全部状态都保存在编译上下文中
+  CompilerContext ctx;
+  CompileCache cache;
+  TimeReport timer;
+  Stats stats;
+  unique_ptr<MemoryReport> memory;
+  bool memory_report = false;
+  const char* memory_json_path = nullptr;
+  bool time_report = false;
+  const char* trace_path = nullptr;
+  for (int i = 5; i < argc; ++i) {
+    string option = argv[i];
+    if (option == "-j" && i + 1 < argc) {
+      ctx.threads = strtoul(argv[++i], nullptr, 10);
+    }
+    else if (option == "-pipeline") {
+      ctx.pipeline = true;
+    }
+    else if (option == "-cache" && i + 1 < argc) {
+      if (!cache.open(argv[++i])) {
+        cerr << "error: cannot open cache directory " << argv[i] << endl;
+        return 1;
+      }
+      ctx.cache = &cache;
+    }
+    else if (option == "-ftime-report") {
+      time_report = true;
+      ctx.timer = &timer;
+    }
+    else if (option == "-ftime-trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+      timer.trace = true;
+      ctx.timer = &timer;
+    }
+    else if (option == "-mem-report" || (option == "-mem-report-json" && i + 1 < argc)) {
+      if (option == "-mem-report") {
+        memory_report = true;
+      }
+      else {
+        memory_json_path = argv[++i];
+      }
+      // 存在 MemoryReport 时才统计堆内存
+      if (memory == nullptr) {
+        memory = make_unique<MemoryReport>();
+      }
+      ctx.memory = memory.get();
+    }
+    else if (option == "-stats") {
+      ctx.stats = &stats;
+    }
+    else if (option == "-finstrument-cycles") {
+      ctx.riscv.instrument = true;
+    }
+    else {
+      cerr << "error: unknown option " << option << endl;
+      return 1;
+    }
+  }
+  auto ret = ctx.compile(mode, input, output);
+  if (ctx.cache != nullptr) {
+    cerr << "cache: " << cache.hits << " hits, " << cache.misses << " misses" << endl;
+  }
+  if (ctx.stats != nullptr) {
+    stats.print(stderr);
+  }
+  if (memory_report) {
+    memory->print(stderr);
+  }
+  if (memory_json_path != nullptr && !memory->write_json(memory_json_path)) {
+    cerr << "error: cannot write memory report " << memory_json_path << endl;
+    return 1;
+  }
+  if (time_report) {
+    timer.print(stderr);
+  }
+  if (trace_path != nullptr && !timer.write_trace(trace_path)) {
+    cerr << "error: cannot write trace file " << trace_path << endl;
+    return 1;
   }
 
-  return 0;
+  return ret ? 0 : 1;
 }
-
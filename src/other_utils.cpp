@@ -0,0 +1,721 @@
+#include "include/other_utils.hpp"
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// AsyncWriter
+
+AsyncWriter::~AsyncWriter() {
+    close();
+}
+
+/**
+ * @brief 打开输出文件
+ * @param[in] path 输出文件路径
+ * @param[in] background 是否使用后台线程写出
+ * @return 是否打开成功
+ */
+bool AsyncWriter::open(const char* path, bool background) {
+    assert(fd < 0);
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    this->background = background;
+    closing = false;
+    error = 0;
+    if (background) {
+        worker = thread(&AsyncWriter::run, this);
+    }
+    return true;
+}
+
+/**
+ * @brief 提交一个缓冲区，缓冲区的内容被移入写出队列
+ * @param[in] buffer 要写出的内容
+ */
+void AsyncWriter::submit(string&& buffer) {
+    if (buffer.empty()) {
+        return;
+    }
+    if (!background) {
+        write_all(buffer);
+        buffer.clear();
+        return;
+    }
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        queue.emplace_back(move(buffer));
+    }
+    buffer.clear();
+    queue_cv.notify_one();
+}
+
+/**
+ * @brief 等待队列中所有缓冲区写出，然后关闭文件
+ * @return 写出或关闭时遇到的第一个错误的 errno，成功时为 0
+ */
+int AsyncWriter::close() {
+    if (fd < 0) {
+        return error;
+    }
+    if (background) {
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            closing = true;
+        }
+        queue_cv.notify_one();
+        worker.join();
+    }
+    if (::close(fd) < 0 && error == 0) {
+        error = errno;
+    }
+    fd = -1;
+    return error;
+}
+
+/**
+ * @brief 后台线程主循环，依次写出队列中的缓冲区
+ */
+void AsyncWriter::run() {
+    while (true) {
+        string buffer;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return closing || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            buffer = move(queue.front());
+            queue.pop_front();
+        }
+        write_all(buffer);
+    }
+}
+
+/**
+ * @brief 将缓冲区完整写入文件，处理部分写入与中断
+ * @note 出错时记录 errno，之后的缓冲区不再写出
+ */
+void AsyncWriter::write_all(const string& buffer) {
+    if (error != 0) {
+        return;
+    }
+    TimeScope scope(timer, "write");
+    const char* data = buffer.data();
+    size_t left = buffer.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            return;
+        }
+        data += written;
+        left -= written;
+    }
+}
+
+// TimeReport
+
+/**
+ * @brief 计算从报告创建到某一时刻经过的微秒数
+ */
+int64_t TimeReport::elapsed(clock::time_point time) const {
+    return chrono::duration_cast<chrono::microseconds>(time - origin).count();
+}
+
+/**
+ * @brief 记录一个计时区间
+ * @param[in] phase 阶段
+ * @param[in] name 区间名，为空时计入阶段累计耗时
+ * @param[in] start 开始时刻
+ * @param[in] end 结束时刻
+ */
+void TimeReport::add(const string& phase, const string& name, clock::time_point start, clock::time_point end) {
+    auto begin = elapsed(start);
+    auto duration = elapsed(end) - begin;
+    lock_guard<mutex> lock(report_mutex);
+    if (name.empty()) {
+        auto it = phases.begin();
+        while (it != phases.end() && it->first != phase) {
+            ++it;
+        }
+        if (it == phases.end()) {
+            phases.emplace_back(phase, duration);
+        }
+        else {
+            it->second += duration;
+        }
+    }
+    if (trace) {
+        auto tid = hash<thread::id>()(this_thread::get_id());
+        spans.push_back(Span{ name.empty() ? phase : name, phase, begin, duration, tid });
+    }
+}
+
+/**
+ * @brief 输出各阶段的累计耗时
+ * @param[in] file 输出文件，通常为 stderr
+ */
+void TimeReport::print(FILE* file) {
+    lock_guard<mutex> lock(report_mutex);
+    auto total = elapsed(clock::now());
+    fprintf(file, "===-------------------------------------------------------------------------===\n");
+    fprintf(file, "                          Compile time report\n");
+    fprintf(file, "===-------------------------------------------------------------------------===\n");
+    fprintf(file, "  %-16s %12s %8s\n", "phase", "time (ms)", "%");
+    for (auto& [phase, duration] : phases) {
+        fprintf(file, "  %-16s %12.3f %7.1f%%\n", phase.c_str(), duration / 1000.0,
+            total > 0 ? 100.0 * duration / total : 0.0);
+    }
+    fprintf(file, "  %-16s %12.3f %7.1f%%\n", "total", total / 1000.0, 100.0);
+}
+
+/**
+ * @brief 将计时区间导出为 Chrome trace-event JSON
+ * @param[in] path 输出文件路径
+ * @return 是否写出成功
+ * @note 每个区间为一个 "ph": "X" 完整事件，线程 id 映射为从 0 开始的小整数
+ */
+bool TimeReport::write_trace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+    lock_guard<mutex> lock(report_mutex);
+    vector<size_t> tids;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < spans.size(); ++i) {
+        auto& span = spans[i];
+        size_t tid = 0;
+        while (tid < tids.size() && tids[tid] != span.tid) {
+            ++tid;
+        }
+        if (tid == tids.size()) {
+            tids.push_back(span.tid);
+        }
+        // 区间名为函数名或阶段名，不含需要转义的字符
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%zu}%s\n",
+            span.name.c_str(), span.category.c_str(), (long long)span.start, (long long)span.duration, tid,
+            i + 1 == spans.size() ? "" : ",");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(file) == 0;
+}
+
+// Stats
+
+/**
+ * @brief 将另一份统计信息累加到当前统计信息中
+ * @param[in] other 另一份统计信息
+ */
+void Stats::merge(const Stats& other) {
+    tokens += other.tokens;
+    for (auto& [type, count] : other.ast_nodes) {
+        ast_nodes[type] += count;
+    }
+    symbol_lookups += other.symbol_lookups;
+    temps += other.temps;
+    folded += other.folded;
+    short_circuits += other.short_circuits;
+    for (auto& [inst, count] : other.riscv_insts) {
+        riscv_insts[inst] += count;
+    }
+}
+
+/**
+ * @brief 输出统计信息
+ * @param[in] file 输出文件，通常为 stderr
+ */
+void Stats::print(FILE* file) const {
+    fprintf(file, "===-------------------------------------------------------------------------===\n");
+    fprintf(file, "                          Compiler statistics\n");
+    fprintf(file, "===-------------------------------------------------------------------------===\n");
+    fprintf(file, "  %10zu tokens lexed\n", tokens);
+    size_t total_nodes = 0;
+    for (auto& [type, count] : ast_nodes) {
+        total_nodes += count;
+    }
+    fprintf(file, "  %10zu AST nodes allocated\n", total_nodes);
+    for (auto& [type, count] : ast_nodes) {
+        fprintf(file, "  %10zu   %s\n", count, type.c_str());
+    }
+    fprintf(file, "  %10zu symbol table lookups\n", symbol_lookups);
+    fprintf(file, "  %10zu temporaries issued\n", temps);
+    fprintf(file, "  %10zu expressions folded to constants\n", folded);
+    fprintf(file, "  %10zu short-circuit blocks emitted\n", short_circuits);
+    size_t total_insts = 0;
+    for (auto& [inst, count] : riscv_insts) {
+        total_insts += count;
+    }
+    fprintf(file, "  %10zu RISC-V lines emitted\n", total_insts);
+    for (auto& [inst, count] : riscv_insts) {
+        fprintf(file, "  %10zu   %s\n", count, inst.c_str());
+    }
+}
+
+// MemoryReport
+
+// 是否统计堆内存，存在 MemoryReport 时开启
+static atomic<bool> heap_counting{false};
+// 当前与最大的堆内存字节数，由 operator new / delete 更新
+static atomic<int64_t> heap_current{0};
+static atomic<int64_t> heap_peak{0};
+
+/**
+ * @brief 每块内存之前的头部，记录该块计入统计的字节数
+ * @note 开启统计之前分配的块记为 0，之后释放时不计入，heap_current 不会因此变为负数
+ * @note 大小为 max_align_t 的对齐值，返回给调用者的地址保持 new 要求的对齐
+ */
+struct alignas(alignof(max_align_t)) HeapHeader {
+    int64_t counted;
+};
+
+/**
+ * @brief 记录一次分配或释放
+ * @param[in] bytes 分配为正，释放为负
+ */
+static void count_heap(int64_t bytes) {
+    auto current = heap_current.fetch_add(bytes, memory_order_relaxed) + bytes;
+    auto peak = heap_peak.load(memory_order_relaxed);
+    while (current > peak && !heap_peak.compare_exchange_weak(peak, current, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief 分配带头部的内存
+ * @return 头部之后的地址，分配失败时为空
+ */
+static void* heap_alloc(size_t size) {
+    auto header = static_cast<HeapHeader*>(malloc(sizeof(HeapHeader) + size));
+    if (header == nullptr) {
+        return nullptr;
+    }
+    header->counted = 0;
+    if (heap_counting.load(memory_order_relaxed)) {
+        header->counted = (int64_t)(malloc_usable_size(header) - sizeof(HeapHeader));
+        count_heap(header->counted);
+    }
+    return header + 1;
+}
+
+/**
+ * @brief 释放 heap_alloc 分配的内存
+ */
+static void heap_free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto header = static_cast<HeapHeader*>(ptr) - 1;
+    if (header->counted != 0) {
+        count_heap(-header->counted);
+    }
+    free(header);
+}
+
+// 替换的 operator delete 内联到容器代码中时，GCC 会误报 new 与 free 不匹配
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// 所有不带对齐参数的 new / delete 都要替换，否则标准库的默认版本会用 free 释放带头部的内存
+
+void* operator new(size_t size) {
+    void* ptr = heap_alloc(size);
+    if (ptr == nullptr) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return heap_alloc(size);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return heap_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    heap_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    heap_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    heap_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    heap_free(ptr);
+}
+
+void operator delete(void* ptr, const nothrow_t&) noexcept {
+    heap_free(ptr);
+}
+
+void operator delete[](void* ptr, const nothrow_t&) noexcept {
+    heap_free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * @brief 读取 /proc/self/status 中的一项，单位 KiB
+ * @param[in] key 项名，如 VmRSS
+ * @return 项的值，读取失败时为 0
+ */
+static int64_t read_proc_status(const char* key) {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    char line[256];
+    int64_t value = 0;
+    size_t key_len = strlen(key);
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ':') {
+            value = strtoll(line + key_len + 1, nullptr, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+MemoryReport::MemoryReport() {
+    // 统计是进程级的，同时只能有一个 MemoryReport
+    bool counting = heap_counting.exchange(true);
+    assert(!counting);
+    (void)counting;
+}
+
+MemoryReport::~MemoryReport() {
+    heap_counting = false;
+}
+
+/**
+ * @brief 开始一个阶段，没有其他阶段进行时重置堆内存与常驻内存的高水位
+ * @return 阶段开始时的内存用量
+ */
+MemoryReport::Mark MemoryReport::begin() {
+    lock_guard<mutex> lock(report_mutex);
+    int64_t heap_begin = heap_current.load();
+    if (active++ == 0) {
+        heap_peak = heap_begin;
+        // 写入 5 重置 VmHWM，内核不支持时 VmHWM 为进程启动以来的高水位
+        int fd = ::open("/proc/self/clear_refs", O_WRONLY);
+        if (fd >= 0) {
+            ssize_t written = ::write(fd, "5", 1);
+            (void)written;
+            ::close(fd);
+        }
+    }
+    return Mark{heap_begin, read_proc_status("VmRSS")};
+}
+
+/**
+ * @brief 结束一个阶段，记录该阶段的高水位，同名阶段合并
+ * @param[in] phase 阶段名
+ * @param[in] mark 阶段开始时 begin 的返回值
+ */
+void MemoryReport::end(const string& phase, const Mark& mark) {
+    lock_guard<mutex> lock(report_mutex);
+    active--;
+    Phase record{
+        phase,
+        mark.heap, heap_current.load(), heap_peak.load(),
+        mark.rss, read_proc_status("VmRSS"), read_proc_status("VmHWM")
+    };
+    for (auto& existing : phases) {
+        if (existing.name == phase) {
+            // 起点按各次的增减之和推算，使增减为各次之和
+            existing.heap_begin = record.heap_end - (existing.heap_end - existing.heap_begin) - (record.heap_end - record.heap_begin);
+            existing.heap_end = record.heap_end;
+            existing.heap_peak = max(existing.heap_peak, record.heap_peak);
+            existing.rss_end = record.rss_end;
+            existing.rss_peak = max(existing.rss_peak, record.rss_peak);
+            return;
+        }
+    }
+    phases.push_back(record);
+}
+
+/**
+ * @brief 以文本形式输出各阶段的内存高水位
+ * @param[in] file 输出文件，通常为 stderr
+ */
+void MemoryReport::print(FILE* file) const {
+    fprintf(file, "===-------------------------------------------------------------------------===\n");
+    fprintf(file, "                          Memory report\n");
+    fprintf(file, "===-------------------------------------------------------------------------===\n");
+    fprintf(file, "  %-12s %14s %14s %14s %14s\n", "phase", "heap peak KiB", "heap +/- KiB", "RSS peak KiB", "RSS end KiB");
+    for (auto& phase : phases) {
+        fprintf(file, "  %-12s %14.1f %+14.1f %14lld %14lld\n", phase.name.c_str(),
+            phase.heap_peak / 1024.0, (phase.heap_end - phase.heap_begin) / 1024.0,
+            (long long)phase.rss_peak, (long long)phase.rss_end);
+    }
+}
+
+/**
+ * @brief 以 JSON 形式输出各阶段的内存高水位
+ * @param[in] path 输出文件路径
+ * @return 是否写出成功
+ * @note 堆内存单位为字节，常驻内存单位为 KiB
+ */
+bool MemoryReport::write_json(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "{\"phases\":[\n");
+    for (size_t i = 0; i < phases.size(); ++i) {
+        auto& phase = phases[i];
+        fprintf(file, "{\"name\":\"%s\",\"heap_begin\":%lld,\"heap_end\":%lld,\"heap_peak\":%lld,"
+            "\"rss_begin_kb\":%lld,\"rss_end_kb\":%lld,\"rss_peak_kb\":%lld}%s\n",
+            phase.name.c_str(), (long long)phase.heap_begin, (long long)phase.heap_end, (long long)phase.heap_peak,
+            (long long)phase.rss_begin, (long long)phase.rss_end, (long long)phase.rss_peak,
+            i + 1 == phases.size() ? "" : ",");
+    }
+    fprintf(file, "]}\n");
+    return fclose(file) == 0;
+}
+
+
+// Arena
+
+/**
+ * @brief 当前块用尽时申请新块并在其中分配
+ * @param[in] size 分配的字节数
+ * @param[in] align 对齐要求
+ * @return 分配得到的地址
+ */
+void* Arena::grow(size_t size, size_t align) {
+    size_t length = max(block_size, size + align);
+    blocks.emplace_back(new char[length]);
+    uintptr_t base = reinterpret_cast<uintptr_t>(blocks.back().get());
+    uintptr_t p = (base + align - 1) & ~(uintptr_t)(align - 1);
+    // 独占的大块不影响当前块的剩余空间
+    if (length == block_size || cur == 0) {
+        cur = p + size;
+        end = base + length;
+    }
+    used += size;
+    return reinterpret_cast<void*>(p);
+}
+
+
+// MappedFile
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+/**
+ * @brief 映射源文件
+ * @param[in] path 源文件路径
+ * @return 是否成功
+ * @note 先保留一段长度为 文件长度 + 2 的匿名映射，再将文件映射到其开头，
+ * @note 文件末页之后的字节与匿名映射部分均为 0，因此末尾总有两个 '\0'
+ */
+bool MappedFile::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t size = st.st_size;
+        size_t total = (size + 2 + page - 1) / page * page;
+        void* region = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region != MAP_FAILED) {
+            void* file = mmap(region, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+            if (file != MAP_FAILED) {
+                ::close(fd);
+                base = static_cast<char*>(region);
+                length = size;
+                mapped_length = total;
+                return true;
+            }
+            munmap(region, total);
+        }
+    }
+
+    // 无法映射，整体读入内存
+    char chunk[1 << 16];
+    ssize_t got;
+    while ((got = ::read(fd, chunk, sizeof(chunk))) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::close(fd);
+            return false;
+        }
+        fallback.append(chunk, got);
+    }
+    ::close(fd);
+    length = fallback.size();
+    fallback.append(2, '\0');
+    base = fallback.data();
+    return true;
+}
+
+/**
+ * @brief 直接载入内存中的源程序文本，不经过文件
+ * @param[in] text 源程序文本
+ */
+void MappedFile::load(string&& text) {
+    close();
+    fallback = move(text);
+    length = fallback.size();
+    fallback.append(2, '\0');
+    base = fallback.data();
+}
+
+/**
+ * @brief 解除映射，此后所有指向文件内容的 StringRef 失效
+ */
+void MappedFile::close() {
+    if (mapped_length != 0) {
+        munmap(base, mapped_length);
+    }
+    fallback.clear();
+    base = nullptr;
+    length = 0;
+    mapped_length = 0;
+}
+
+
+// ThreadPool
+
+/**
+ * @brief 创建线程池
+ * @param[in] threads 线程数，为 0 时使用 1 个线程
+ */
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues.emplace_back(make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+/**
+ * @brief 等待所有任务完成后结束全部线程
+ */
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        lock_guard<mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief 提交任务
+ * @param[in] task 任务
+ */
+void ThreadPool::submit(function<void()> task) {
+    pending++;
+    auto& queue = *queues[next_queue++ % queues.size()];
+    {
+        lock_guard<mutex> lock(queue.queue_mutex);
+        queue.tasks.emplace_back(move(task));
+    }
+    {
+        // 持有 state_mutex 修改 queued，避免空闲线程错过唤醒
+        lock_guard<mutex> lock(state_mutex);
+        queued++;
+    }
+    work_cv.notify_one();
+}
+
+/**
+ * @brief 等待所有已提交的任务完成
+ */
+void ThreadPool::wait() {
+    unique_lock<mutex> lock(state_mutex);
+    done_cv.wait(lock, [this] { return pending == 0; });
+}
+
+/**
+ * @brief 取一个任务，先取自己队列的头部，再窃取其他队列的尾部
+ * @param[in] id 线程编号
+ * @param[out] task 取到的任务
+ * @return 是否取到任务
+ */
+bool ThreadPool::try_pop(size_t id, function<void()>& task) {
+    for (size_t i = 0; i < queues.size(); ++i) {
+        auto& queue = *queues[(id + i) % queues.size()];
+        lock_guard<mutex> lock(queue.queue_mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 工作线程主循环
+ * @param[in] id 线程编号
+ */
+void ThreadPool::run(size_t id) {
+    while (true) {
+        function<void()> task;
+        if (try_pop(id, task)) {
+            task();
+            if (--pending == 0) {
+                lock_guard<mutex> lock(state_mutex);
+                done_cv.notify_all();
+            }
+            continue;
+        }
+        unique_lock<mutex> lock(state_mutex);
+        work_cv.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
\ No newline at end of file
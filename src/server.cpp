@@ -0,0 +1,163 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "include/server.hpp"
+#include "include/context.hpp"
+
+/**
+ * @brief 处理一个连接上的编译请求
+ * @param[in] fd 连接
+ */
+static void serve(int fd) {
+    string mode, kind, input, output, program_input;
+    if (!read_field(fd, mode) || !read_field(fd, kind) || !read_field(fd, input) || !read_field(fd, output)
+        || !read_field(fd, program_input)) {
+        ::close(fd);
+        return;
+    }
+
+    // 诊断信息与 -interp 的程序输出都收集到字符串中返回给客户端，程序输入来自客户端
+    CompilerContext ctx;
+    bool ok = false;
+    string message, program_output;
+    ctx.diagnostics = &message;
+    ctx.program_output = &program_output;
+    ctx.program_input = &program_input;
+    try {
+        if (kind == "path") {
+            ok = ctx.compile(mode, input.c_str(), output.c_str());
+        }
+        else if (kind == "source") {
+            ctx.source.load(move(input));
+            ok = ctx.compile_source(mode, output.c_str());
+        }
+        else {
+            ctx.error("unknown input kind " + kind);
+        }
+    }
+    catch (const exception& e) {
+        // 一个请求的失败不能终止服务
+        ok = false;
+        message += string("error: internal compiler error: ") + e.what() + "\n";
+    }
+
+    write_field(fd, ok ? "0" : "1");
+    write_field(fd, message);
+    write_field(fd, program_output);
+    ::close(fd);
+}
+
+/**
+ * @brief 判断连接的对端是否与服务是同一用户
+ * @param[in] fd 连接
+ * @note 套接字所在目录的权限可能被放宽，权限位之外再检查对端凭据
+ */
+static bool same_user(int fd) {
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        return false;
+    }
+    return cred.uid == getuid();
+}
+
+/**
+ * @brief 判断套接字路径上是否已有服务在监听
+ * @param[in] addr 套接字地址
+ */
+static bool server_running(const sockaddr_un& addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool running = connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    ::close(fd);
+    return running;
+}
+
+/**
+ * @brief 服务模式入口，常驻进程并通过 Unix 域套接字接收编译请求
+ * @note 用法：compiler -server [套接字路径] [-j 线程数]
+ * @note 套接字路径默认由 server_socket_path() 决定
+ * @note 每个连接处理一个请求，请求在线程池中并行编译
+ * @note 服务以启动者的权限读写任意路径，套接字只允许启动者访问，并拒绝其他用户的连接
+ * @note 路径上已有服务在监听时拒绝启动；只删除无人监听的残留套接字，不删除其他类型的文件
+ */
+int run_server(int argc, const char* argv[]) {
+    string path = server_socket_path();
+    size_t threads = thread::hardware_concurrency();
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            threads = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "-mem-report" || arg == "-mem-report-json") {
+            // 堆内存统计是进程级的，无法区分同时进行的各个请求
+            cerr << "error: " << arg << " is not supported in server mode" << endl;
+            return 1;
+        }
+        else {
+            path = arg;
+        }
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "error: socket path too long: " << path << endl;
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+
+    if (server_running(addr)) {
+        cerr << "error: a compiler server is already listening on " << path << endl;
+        return 1;
+    }
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    // 套接字文件的权限为 0600，其他用户无法连接
+    mode_t old_mask = umask(077);
+    int bound = bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    umask(old_mask);
+    if (bound < 0 || listen(listen_fd, 128) < 0) {
+        perror("bind");
+        ::close(listen_fd);
+        return 1;
+    }
+    // 客户端提前断开时不应终止服务
+    signal(SIGPIPE, SIG_IGN);
+    cerr << "compiler server listening on " << path << endl;
+
+    ThreadPool pool(threads);
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        if (!same_user(fd)) {
+            ::close(fd);
+            continue;
+        }
+        pool.submit([fd] { serve(fd); });
+    }
+    ::close(listen_fd);
+    unlink(path.c_str());
+    return 1;
+}
@@ -4,6 +4,14 @@
   #include <memory>
   #include <string>
   #include "include/ast.hpp"
+
+  class CompilerContext;
+
+  // 可重入 lexer 的句柄类型, 与 flex 生成的定义一致
+  #ifndef YY_TYPEDEF_YY_SCANNER_T
+  #define YY_TYPEDEF_YY_SCANNER_T
+  typedef void *yyscan_t;
+  #endif
 }
 
 %{
@@ -12,33 +20,53 @@
 #include <memory>
 #include <string>
 #include "include/ast.hpp"
+#include "include/context.hpp"
 
 using namespace std;
 
+%}
+
+%code {
 // 声明 lexer 函数和错误处理函数
-int yylex();
-void yyerror(unique_ptr<BaseAST> &ast, const char *s);
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+void yyerror(yyscan_t scanner, CompilerContext &ctx, const char *s);
+
+// 在编译上下文的 arena 中分配 AST 节点, -stats 模式下按类型统计分配数
+#define NEW_AST_(type) (STAT_(ctx.stats, ast_nodes[#type]), ctx.arena.make<type>())
+// 在 arena 中分配 parser 构建列表用的临时链表
+#define NEW_LIST_ ctx.arena.make<ArenaList<BaseAST *>>()
+// 向表达式构建器追加一个节点, -stats 模式下统计节点数
+#define NEW_EXPR_(kind, ...) (STAT_(ctx.stats, ast_nodes["ExprNode"]), ctx.expr_builder.kind(__VA_ARGS__))
+}
 
-%}
+// 生成可重入 (pure) 的 parser, 不使用全局的 yylval 等状态
+// lexer 句柄由调用者创建, 并通过附加参数传递给 yylex
+%define api.pure full
+%lex-param { yyscan_t scanner }
 
 // 定义 parser 函数和错误处理函数的附加参数
-// 我们需要返回一个字符串作为 AST, 所以我们把附加参数定义成字符串的智能指针
-// 解析完成后, 我们要手动修改这个参数, 把它设置成解析得到的字符串
-%parse-param { unique_ptr<BaseAST> &ast }
+// 解析完成后, 我们把解析得到的 AST 保存到编译上下文 ctx.ast 中, 所有节点都分配在 ctx.arena 中
+// 流水线模式下, 每个函数一经规约就通过 ctx.func_queue 交给后续阶段
+%parse-param { yyscan_t scanner } { CompilerContext &ctx }
 
 // yylval 的定义, 我们把它定义成了一个联合体 (union)
 %union {
-  string *str_val;
+  IdentRef ident_val;
+  ExprOp op_val;
   int int_val;
   BaseAST *ast_val;
-  vector<unique_ptr<BaseAST>> *vec_val;
+  ArenaList<BaseAST *> *list_val;
+  int32_t expr_val;
 }
 
 // lexer 返回的所有 token 种类的声明
-// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 str_val 和 int_val
+// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 ident_val 和 int_val
+// IDENT 的值直接指向源文件映射中的字符, 不分配内存, 并带有 lexer 分配的驻留编号
+// 运算符 token 按优先级分类, 值为具体的运算符, AddOp 的值为二元的 ADD / SUB
 %token INT VOID CONST RETURN
-%token <str_val> IDENT
-%token <str_val> EqOp RelOp AddOp NotOp MulOp AndOp OrOp
+%token <ident_val> IDENT
+%token <op_val> EqOp RelOp AddOp NotOp MulOp
+%token AndOp OrOp
 %token <int_val> INT_CONST
 
 
@@ -47,10 +75,11 @@ void yyerror(unique_ptr<BaseAST> &ast, const char *s);
 %type <ast_val> FuncDef
 %type <ast_val> Decl ConstDecl ConstDef ConstInitVal
 %type <ast_val> Block BlockItem Stmt 
-%type <ast_val> ConstExp LVal Exp PrimaryExp UnaryExp AddExp MulExp LOrExp LAndExp EqExp RelExp
+%type <ast_val> ConstExp LVal Exp
+%type <expr_val> PrimaryExp UnaryExp AddExp MulExp LOrExp LAndExp EqExp RelExp
 
 
-%type <vec_val> ExtendCompUnit ExtendBlockItem ExtendConstDef
+%type <list_val> ExtendCompUnit ExtendBlockItem ExtendConstDef
 
 %type <int_val> Number
 
@@ -58,49 +87,54 @@ void yyerror(unique_ptr<BaseAST> &ast, const char *s);
 
 Program
   : CompUnit ExtendCompUnit {
-    auto program = make_unique<ProgramAST>();
+    auto program = NEW_AST_(ProgramAST);
     auto comp_unit = $1;
-    vector<unique_ptr<BaseAST>> *comp_unit_vec = $2;
-    program->comp_units.emplace_back(move(comp_unit));
-    for (auto& comp_unit : *comp_unit_vec) {
-      program->comp_units.emplace_back(move(comp_unit));
-    }
-    ast = move(program);
+    ArenaList<BaseAST *> *comp_unit_list = $2;
+    program->comp_units = comp_unit_list->flatten(ctx.arena, comp_unit != nullptr ? &comp_unit : nullptr);
+    ctx.ast = program;
   }
   ;
 
 ExtendCompUnit
   : {
-    vector<unique_ptr<BaseAST>>* comp_unit_vec = new vector<unique_ptr<BaseAST>>;
     // $$ 是 Bison 提供的宏, 它代表当前规则的返回值
-    $$ = comp_unit_vec;
+    $$ = NEW_LIST_;
   }
   | ExtendCompUnit CompUnit {
-    vector<unique_ptr<BaseAST>>* comp_unit_vec = $1;
-    comp_unit_vec->emplace_back(move($2));
-    $$ = comp_unit_vec;
+    ArenaList<BaseAST *> *comp_unit_list = $1;
+    if ($2 != nullptr) {
+      comp_unit_list->push_back(ctx.arena, $2);
+    }
+    $$ = comp_unit_list;
   }
   ;
 
 CompUnit
   : FuncDef {
-    $$ = $1;
+    if (ctx.func_queue != nullptr) {
+      // 流水线模式, 函数交给 IR 生成阶段, 不再保留在 Program 中
+      ctx.func_queue->push($1);
+      $$ = nullptr;
+    }
+    else {
+      $$ = $1;
+    }
   }
   ;
 
 FuncDef
   : INT IDENT '(' ')' Block {
-    auto ast = new FuncDefAST();
+    auto ast = NEW_AST_(FuncDefAST);
     ast->func_type = FuncDefAST::FuncType::INT;
-    ast->ident = *unique_ptr<string>($2);
-    ast->block = unique_ptr<BaseAST>($5);
+    ast->ident = $2.text;
+    ast->block = $5;
     $$ = ast;
   }
   | VOID IDENT '(' ')' Block {
-    auto ast = new FuncDefAST();
+    auto ast = NEW_AST_(FuncDefAST);
     ast->func_type = FuncDefAST::FuncType::VOID;
-    ast->ident = *unique_ptr<string>($2);
-    ast->block = unique_ptr<BaseAST>($5);
+    ast->ident = $2.text;
+    ast->block = $5;
     $$ = ast;
   }
   ;
@@ -108,33 +142,28 @@ FuncDef
 Block
   : '{' BlockItem ExtendBlockItem '}' {
     // 带语句的块
-    auto ast = new BlockAST();
+    auto ast = NEW_AST_(BlockAST);
     auto block_item = $2;
-    vector<unique_ptr<BaseAST>> *block_item_vec = $3;
-    ast->block_items.emplace_back(move(block_item));
-    for (auto& block_item : *block_item_vec) {
-      ast->block_items.emplace_back(move(block_item));
-    }
+    ArenaList<BaseAST *> *block_item_list = $3;
+    ast->block_items = block_item_list->flatten(ctx.arena, &block_item);
     $$ = ast;
   }
   | '{' '}'{
     // 空块
-    auto ast = new BlockAST();
-    ast->block_items = vector<unique_ptr<BaseAST>>();
+    auto ast = NEW_AST_(BlockAST);
     $$ = ast;
   }
   ;
 
 ExtendBlockItem
   : {
-    vector<unique_ptr<BaseAST>> *block_item_vec = new vector<unique_ptr<BaseAST>>;
-    $$ = block_item_vec;
+    $$ = NEW_LIST_;
   }
   | ExtendBlockItem BlockItem {
-    // 从 ExtendBlockItem 规约到 BlockItem, 则把 BlockItem 的解析返回值移动到 ExtendBlockItem 的 vector 中
-    vector<unique_ptr<BaseAST>> *block_item_vec = $1;
-    block_item_vec->emplace_back(move($2));
-    $$ = block_item_vec;
+    // 从 ExtendBlockItem 规约到 BlockItem, 则把 BlockItem 的解析返回值追加到 ExtendBlockItem 的链表中
+    ArenaList<BaseAST *> *block_item_list = $1;
+    block_item_list->push_back(ctx.arena, $2);
+    $$ = block_item_list;
   }
   ;
 
@@ -158,51 +187,47 @@ Decl
 ConstDecl
   : CONST INT ConstDef ExtendConstDef ';' {
     // 常量声明，要处理一行有多个常量定义的情况，如 int a = 1, b = 2;
-    auto ast = new ConstDeclAST();
+    auto ast = NEW_AST_(ConstDeclAST);
     auto const_def = $3;
-    vector<unique_ptr<BaseAST>> *vec = $4;
-    ast->const_defs.push_back(unique_ptr<BaseAST>(const_def));
-    for (auto& ptr : *vec) {
-      ast->const_defs.push_back(move(ptr));
-    }
+    ArenaList<BaseAST *> *const_def_list = $4;
+    ast->const_defs = const_def_list->flatten(ctx.arena, &const_def);
     $$ = ast;
   }
   ;
 
 ExtendConstDef
   : {
-    vector<unique_ptr<BaseAST>> *vec = new vector<unique_ptr<BaseAST>>;
-    $$ = vec;
+    $$ = NEW_LIST_;
   }
   | ExtendConstDef ',' ConstDef {
-    vector<unique_ptr<BaseAST>> *vec = $1;
-    vec->push_back(unique_ptr<BaseAST>($3));
-    $$ = vec;
+    ArenaList<BaseAST *> *const_def_list = $1;
+    const_def_list->push_back(ctx.arena, $3);
+    $$ = const_def_list;
   }
   ;
 
 ConstDef
   : IDENT '=' ConstInitVal {
     // 常量定义
-    auto ast = new ConstDefAST();
-    ast->ident = *unique_ptr<string>($1);
-    ast->value = unique_ptr<BaseAST>($3);
+    auto ast = NEW_AST_(ConstDefAST);
+    ast->ident = $1.id;
+    ast->value = $3;
     $$ = ast;
   }
   ;
 
 ConstInitVal
   : ConstExp {
-    auto ast = new ConstInitValAST();
-    ast->const_exp = unique_ptr<BaseAST>($1);
+    auto ast = NEW_AST_(ConstInitValAST);
+    ast->const_exp = $1;
     $$ = ast;
   }
   ;
 
 ConstExp
   : Exp {
-    auto ast = new ConstExpAST();
-    ast->exp = unique_ptr<BaseAST>($1);
+    auto ast = NEW_AST_(ConstExpAST);
+    ast->exp = $1;
     $$ = ast;
   }
   ;
@@ -217,13 +242,13 @@ Stmt
   }
   | RETURN Exp ';' {
     // 返回值, return exp;
-    auto ast = new StmtReturnAST();
-    ast->exp = unique_ptr<BaseAST>($2);
+    auto ast = NEW_AST_(StmtReturnAST);
+    ast->exp = $2;
     $$ = ast;
   }
   | RETURN ';' {
     // 空返回, return;
-    auto ast = new StmtReturnAST();
+    auto ast = NEW_AST_(StmtReturnAST);
     $$ = ast;
   }
   ;
@@ -231,157 +256,101 @@ Stmt
 LVal
   : IDENT  {
     // 左值
-    auto ast = new LValAST();
-    ast->ident = *unique_ptr<string>($1);
+    auto ast = NEW_AST_(LValAST);
+    ast->ident = $1.id;
     $$ = ast;
   }
   ;
 
 Exp
   : LOrExp {
-    auto ast = new ExpAST();
-    ast->l_or_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    // 表达式结束, 构建器中的节点复制为一个紧凑表达式树
+    $$ = ctx.expr_builder.finish(ctx.arena);
+    STAT_(ctx.stats, ast_nodes["ExpAST"]);
   }
   ;
 
+// 以下表达式规则的值都是节点在 ctx.expr_builder 中的下标
+// 只由一个子表达式构成的规则直接传递下标, 不产生节点
 LOrExp
   : LAndExp {
-    auto ast = new LOrExpAST();
-    ast->l_and_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | LOrExp OrOp LAndExp {
-    auto ast = new LExpWithOpAST();
-    ast->logical_op = LExpWithOpAST::LogicalOp::LOGICAL_OR;
-    ast->left = unique_ptr<BaseAST>($1);
-    ast->right = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = NEW_EXPR_(binary, ExprOp::LOGICAL_OR, $1, $3);
   }
   ;
 
 LAndExp 
   : EqExp {
-    auto ast = new LAndExpAST();
-    ast->eq_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | LAndExp AndOp EqExp {
-    auto ast = new LExpWithOpAST();
-    ast->logical_op = LExpWithOpAST::LogicalOp::LOGICAL_AND;
-    ast->left = unique_ptr<BaseAST>($1);
-    ast->right = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = NEW_EXPR_(binary, ExprOp::LOGICAL_AND, $1, $3);
   }
   ;
 
 EqExp
   : RelExp {
-    auto ast = new EqExpAST();
-    ast->rel_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | EqExp EqOp RelExp {
-    auto ast = new EqExpWithOpAST();
-    auto eq_op = *unique_ptr<string>($2);
-    ast->eq_op = ast->convert(eq_op);
-    ast->left = unique_ptr<BaseAST>($1);
-    ast->right = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = NEW_EXPR_(binary, $2, $1, $3);
   }
   ;
 
 RelExp
   : AddExp {
-    auto ast = new RelExpAST();
-    ast->add_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | RelExp RelOp AddExp {
-    auto ast = new RelExpWithOpAST();
-    auto rel_op = *unique_ptr<string>($2);
-    ast->rel_op = ast->convert(rel_op);
-    ast->left = unique_ptr<BaseAST>($1);
-    ast->right = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = NEW_EXPR_(binary, $2, $1, $3);
   }
   ;
 
 AddExp
   : MulExp {
-    // 乘法表达式
-    auto ast = new AddExpAST();
-    ast->mul_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | AddExp AddOp MulExp {
-    auto ast = new AddExpWithOpAST();
-    auto add_op = *unique_ptr<string>($2);
-    ast->add_op = ast->convert(add_op);
-    ast->left = unique_ptr<BaseAST>($1);
-    ast->right = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = NEW_EXPR_(binary, $2, $1, $3);
   }
   ;
 
 MulExp
   : UnaryExp {
-    auto ast = new MulExpAST();
-    ast->unary_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | MulExp MulOp UnaryExp {
-    auto ast = new MulExpWithOpAST();
-    auto mul_op = *unique_ptr<string>($2);
-    ast->mul_op = ast->convert(mul_op);
-    ast->left = unique_ptr<BaseAST>($1);
-    ast->right = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = NEW_EXPR_(binary, $2, $1, $3);
   }
   ;
 
 UnaryExp
   : PrimaryExp {
-    // 括号运算符表达式，如 (a)
-    auto ast = new UnaryExpAST();
-    ast->primary_exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | AddOp UnaryExp {
-    auto ast = new UnaryExpWithOpAST();
-    auto add_op = *unique_ptr<string>($1);
-    ast->unary_op = ast->convert(add_op);
-    ast->unary_exp = unique_ptr<BaseAST>($2);
-    $$ = ast;
+    $$ = NEW_EXPR_(unary, $1 == ExprOp::ADD ? ExprOp::POSITIVE : ExprOp::NEGATIVE, $2);
   }
   | NotOp UnaryExp {
-    auto ast = new UnaryExpWithOpAST();
-    auto not_op = *unique_ptr<string>($1);
-    ast->unary_op = ast->convert(not_op);
-    ast->unary_exp = unique_ptr<BaseAST>($2);
-    $$ = ast;
+    $$ = NEW_EXPR_(unary, $1, $2);
   }
   ;
 
 PrimaryExp
-  : '(' Exp ')' {
-    auto ast = new PrimaryExpAST();
-    ast->exp = unique_ptr<BaseAST>($2);
-    $$ = ast;
+  : '(' LOrExp ')' {
+    // 括号表达式, 如 (a), 与外层表达式共用节点数组
+    $$ = $2;
   } 
   | Number {
-    auto ast = new PrimaryExpWithNumberAST();
-    ast->number = $1;
-    $$ = ast;
+    $$ = NEW_EXPR_(number, $1);
   }
   | LVal {
     // 变量表达式，如 a
-    auto ast = new PrimaryExpWithLValAST();
-    ast->l_val = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = NEW_EXPR_(l_val, static_cast<LValAST *>($1));
   }
   ;
-  ;
 
 Number
   : INT_CONST { 
@@ -393,6 +362,6 @@ Number
 
 // 定义错误处理函数, 其中第二个参数是错误信息
 // parser 如果发生错误 (例如输入的程序出现了语法错误), 就会调用这个函数
-void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
-  cerr << "error: " << s << endl;
+void yyerror(yyscan_t scanner, CompilerContext &ctx, const char *s) {
+  ctx.error(s);
 }
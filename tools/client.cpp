@@ -0,0 +1,79 @@
+// 编译服务的客户端, 用法与编译器相同, 可直接替换 compiler:
+//   compiler-client 模式 输入文件 -o 输出文件
+// 输入文件为 - 时从标准输入读取源程序, 并将源程序文本发给服务端;
+// 否则 -interp 模式下标准输入不是终端时, 将其内容作为程序输入发给服务端
+// 套接字路径由环境变量 SYSY_COMPILER_SOCKET 指定, 默认为 $XDG_RUNTIME_DIR/sysy-compiler.sock 或 /tmp/sysy-compiler-<uid>.sock
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "include/server.hpp"
+
+using namespace std;
+
+/**
+ * @brief 将路径转换为绝对路径，服务端的工作目录与客户端不同
+ */
+static string absolute_path(const string& path) {
+    if (!path.empty() && path[0] == '/') {
+        return path;
+    }
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+        return path;
+    }
+    return string(cwd) + "/" + path;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 5) {
+        cerr << "usage: compiler-client <mode> <input> -o <output>" << endl;
+        return 1;
+    }
+    string mode = argv[1];
+    string input = argv[2];
+    string output = absolute_path(argv[4]);
+
+    string kind = "path";
+    string program_input;
+    if (input == "-") {
+        kind = "source";
+        input.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    }
+    else {
+        input = absolute_path(input);
+        if (mode == "-interp" && !isatty(STDIN_FILENO)) {
+            program_input.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+        }
+    }
+
+    string path = server_socket_path();
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "error: socket path too long: " << path << endl;
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        cerr << "error: cannot connect to compiler server at " << path << endl;
+        return 1;
+    }
+
+    string status, message, program_output;
+    if (!write_field(fd, mode) || !write_field(fd, kind) || !write_field(fd, input) || !write_field(fd, output)
+        || !write_field(fd, program_input) || !read_field(fd, status) || !read_field(fd, message) || !read_field(fd, program_output)) {
+        cerr << "error: connection to compiler server lost" << endl;
+        ::close(fd);
+        return 1;
+    }
+    ::close(fd);
+
+    cout << program_output << flush;
+    cerr << message;
+    return atoi(status.c_str());
+}
@@ -0,0 +1,269 @@
+// 生成代码质量回归测试
+// 以 -riscv 模式编译语料目录中的每个 SysY 程序, 统计生成的汇编:
+//   静态指令数、代码字节数、每个函数的栈帧大小与指令分布,
+// 与检入的基线比较, 任一指标超过基线的 (1 + 阈值) 倍时视为退化, 以非零退出码结束;
+// 基线中有而语料中没有的程序同样以非零退出码结束, 删除程序后需要 -update
+// 用法: codequality [-update] [-t 阈值, 默认 0.05] 编译器 语料目录 基线文件
+//   -update 用本次结果覆盖基线文件
+// 基线文件每行为 "程序 指标 值", 指标为 insts / bytes / frame:函数名 / mix:助记符,
+// 指令分布的变化只作为提示输出, 不视为退化
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// 程序名 -> 指标 -> 值
+using Metrics = map<string, map<string, long>>;
+
+/**
+ * @brief 运行编译器
+ * @return 是否编译成功
+ */
+static bool run_compiler(const string& compiler, const string& input, const string& output) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        execl(compiler.c_str(), compiler.c_str(), "-riscv", input.c_str(), "-o", output.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * @brief 判断立即数能否放入 12 位有符号立即数
+ */
+static bool fits_imm12(long value) {
+    return value >= -2048 && value <= 2047;
+}
+
+/**
+ * @brief 统计一个汇编文件
+ * @param[in] path 汇编文件路径
+ * @param[out] metrics 该程序的指标
+ * @note 伪指令按汇编器展开后的条数计算：超出 12 位的 li、la 与 call 各为 2 条
+ * @note 栈帧大小取函数中第一条调整 sp 的指令：addi sp, sp, -N 或 li t0, -N; add sp, sp, t0
+ */
+static void analyze(const string& path, map<string, long>& metrics) {
+    ifstream input(path);
+    string line;
+    string func;
+    long insts = 0;
+    // li 到各寄存器的最近一次立即数，用于识别大栈帧
+    map<string, long> last_li;
+    // 由 .globl 声明的符号，只有它们的标签才是函数入口，其余为基本块标签
+    set<string> globals;
+    while (getline(input, line)) {
+        auto comment = line.find('#');
+        if (comment != string::npos) {
+            line.erase(comment);
+        }
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == string::npos) {
+            continue;
+        }
+        line = line.substr(start);
+        if (line.back() == ':') {
+            auto label = line.substr(0, line.size() - 1);
+            if (globals.count(label)) {
+                func = label;
+                metrics["frame:" + func] += 0;
+                last_li.clear();
+            }
+            continue;
+        }
+        if (line[0] == '.') {
+            if (line.compare(0, 6, ".globl") == 0) {
+                stringstream ss(line.substr(6));
+                string name;
+                ss >> name;
+                globals.insert(name);
+            }
+            continue;
+        }
+        stringstream ss(line);
+        string mnemonic;
+        ss >> mnemonic;
+        vector<string> operands;
+        string operand;
+        while (getline(ss, operand, ',')) {
+            auto first = operand.find_first_not_of(" \t\r");
+            auto last = operand.find_last_not_of(" \t\r");
+            operands.push_back(first == string::npos ? "" : operand.substr(first, last - first + 1));
+        }
+        long count = 1;
+        if (mnemonic == "li" && operands.size() == 2) {
+            long value = strtol(operands[1].c_str(), nullptr, 0);
+            last_li[operands[0]] = value;
+            count = fits_imm12(value) ? 1 : 2;
+        }
+        else if (mnemonic == "la" || mnemonic == "call") {
+            count = 2;
+        }
+        auto& frame = metrics["frame:" + func];
+        if (frame == 0 && operands.size() == 3 && operands[0] == "sp" && operands[1] == "sp") {
+            if (mnemonic == "addi") {
+                frame = max(0L, -strtol(operands[2].c_str(), nullptr, 0));
+            }
+            else if (mnemonic == "add" && last_li.count(operands[2])) {
+                frame = max(0L, -last_li[operands[2]]);
+            }
+        }
+        insts += count;
+        metrics["mix:" + mnemonic] += count;
+    }
+    metrics["insts"] = insts;
+    metrics["bytes"] = insts * 4;
+}
+
+/**
+ * @brief 读取基线文件
+ */
+static Metrics read_baseline(const string& path) {
+    Metrics baseline;
+    ifstream input(path);
+    string program, metric;
+    long value;
+    string line;
+    while (getline(input, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        stringstream ss(line);
+        if (ss >> program >> metric >> value) {
+            baseline[program][metric] = value;
+        }
+    }
+    return baseline;
+}
+
+/**
+ * @brief 写入基线文件
+ */
+static bool write_baseline(const string& path, const Metrics& metrics) {
+    ofstream output(path);
+    output << "# 生成代码质量基线, 由 codequality -update 生成" << '\n';
+    output << "# 程序 指标 值" << '\n';
+    for (auto& [program, values] : metrics) {
+        for (auto& [metric, value] : values) {
+            output << program << ' ' << metric << ' ' << value << '\n';
+        }
+    }
+    return (bool)output;
+}
+
+int main(int argc, const char* argv[]) {
+    bool update = false;
+    double threshold = 0.05;
+    vector<string> args;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "-update") {
+            update = true;
+        }
+        else if (option == "-t" && i + 1 < argc) {
+            threshold = strtod(argv[++i], nullptr);
+        }
+        else {
+            args.push_back(option);
+        }
+    }
+    if (args.size() != 3) {
+        cerr << "usage: " << argv[0] << " [-update] [-t threshold] compiler corpus_dir baseline" << endl;
+        return 2;
+    }
+    auto& compiler = args[0];
+    auto& corpus = args[1];
+    auto& baseline_path = args[2];
+
+    vector<string> programs;
+    if (DIR* dir = opendir(corpus.c_str())) {
+        while (auto entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.size() > 2 && name.substr(name.size() - 2) == ".c") {
+                programs.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+    sort(programs.begin(), programs.end());
+    if (programs.empty()) {
+        cerr << "error: no .c files in " << corpus << endl;
+        return 2;
+    }
+
+    Metrics metrics;
+    string output = "/tmp/codequality." + to_string(getpid()) + ".S";
+    bool failed = false;
+    for (auto& program : programs) {
+        if (!run_compiler(compiler, corpus + "/" + program, output)) {
+            cerr << "FAIL " << program << ": compilation failed" << endl;
+            failed = true;
+            continue;
+        }
+        analyze(output, metrics[program]);
+    }
+    unlink(output.c_str());
+
+    if (update) {
+        if (!write_baseline(baseline_path, metrics)) {
+            cerr << "error: cannot write " << baseline_path << endl;
+            return 2;
+        }
+        cout << "baseline updated: " << programs.size() << " programs" << endl;
+        return failed ? 1 : 0;
+    }
+
+    auto baseline = read_baseline(baseline_path);
+    size_t regressions = 0, improvements = 0, missing = 0;
+    for (auto& [program, values] : metrics) {
+        auto base_it = baseline.find(program);
+        if (base_it == baseline.end()) {
+            cout << "NEW  " << program << " (not in baseline)" << endl;
+            continue;
+        }
+        auto& base = base_it->second;
+        for (auto& [metric, value] : values) {
+            auto it = base.find(metric);
+            long old = it == base.end() ? 0 : it->second;
+            if (value == old) {
+                continue;
+            }
+            bool is_mix = metric.compare(0, 4, "mix:") == 0;
+            if (!is_mix && value > old * (1 + threshold)) {
+                ++regressions;
+                cout << "REGRESSION " << program << ' ' << metric << ": " << old << " -> " << value << endl;
+            }
+            else if (value < old) {
+                ++improvements;
+                cout << "improved   " << program << ' ' << metric << ": " << old << " -> " << value << endl;
+            }
+            else {
+                cout << "changed    " << program << ' ' << metric << ": " << old << " -> " << value << endl;
+            }
+        }
+    }
+    for (auto& [program, values] : baseline) {
+        if (!metrics.count(program)) {
+            ++missing;
+            cout << "MISSING " << program << " (in baseline but not in corpus)" << endl;
+        }
+    }
+    cout << programs.size() << " programs, " << regressions << " regressions, " << improvements << " improvements, "
+         << missing << " missing" << endl;
+    return failed || regressions > 0 || missing > 0 ? 1 : 0;
+}
@@ -0,0 +1,767 @@
+// RV32IM 汇编模拟器
+// 直接解释执行 Riscv 类生成的汇编文本, 不需要 RISC-V 硬件或交叉工具链,
+// 统计动态指令数、访存次数、跳转次数与估计周期数, 用于衡量生成代码的质量
+// 用法: rvsim [-q] [-m 内存MiB] [-max 最大指令数] 汇编文件 [< 程序输入]
+//   -q 不输出统计报告, 只以 main 的返回值作为退出码
+//   -m 栈空间大小, 1 ~ 2047 MiB, 默认 16
+// 参数错误、汇编失败或运行出错时退出码为 125, 并在 stderr 输出 "error: ...", 与程序的返回值区分
+// 统计报告以 "项: 值" 的形式输出到 stderr, 程序通过 putint 等库函数的输出写到 stdout
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief 指令种类，包含 RV32IM 的基本指令与汇编器支持的伪指令
+ */
+enum class Op {
+    // 寄存器-寄存器运算
+    ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND,
+    MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU,
+    // 寄存器-立即数运算
+    ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI, LUI, AUIPC,
+    // 访存
+    LB, LH, LW, LBU, LHU, SB, SH, SW,
+    // 分支与跳转
+    BEQ, BNE, BLT, BGE, BLTU, BGEU, JAL, JALR,
+    // 伪指令
+    LI, LA, MV, NOT, NEG, SEQZ, SNEZ, SLTZ, SGTZ, SGT, SGTU,
+    BEQZ, BNEZ, BLEZ, BGEZ, BLTZ, BGTZ, BGT, BLE, BGTU, BLEU,
+    J, JR, CALL, RET, NOP,
+    // 性能计数器
+    RDCYCLE, RDINSTRET,
+};
+
+/**
+ * @brief 指令的操作数格式，决定如何解析操作数
+ */
+enum class Format {
+    // rd, rs1, rs2
+    R,
+    // rd, rs1, imm
+    I,
+    // rd, imm
+    U,
+    // rd, imm(rs1)
+    LOAD,
+    // rs2, imm(rs1)
+    STORE,
+    // rs1, rs2, label
+    BRANCH,
+    // rs1, label
+    BRANCH_ZERO,
+    // rd, rs1
+    RR,
+    // rd, label
+    LABEL_RD,
+    // label
+    LABEL,
+    // [rd,] label
+    JAL,
+    // [rd,] [imm(]rs1[)]
+    JALR,
+    // rs1
+    REG,
+    // rd
+    RD,
+    // 无操作数
+    NONE,
+};
+
+struct OpInfo {
+    Op op;
+    Format format;
+};
+
+static const unordered_map<string, OpInfo> op_table = {
+    { "add", { Op::ADD, Format::R } }, { "sub", { Op::SUB, Format::R } },
+    { "sll", { Op::SLL, Format::R } }, { "slt", { Op::SLT, Format::R } },
+    { "sltu", { Op::SLTU, Format::R } }, { "xor", { Op::XOR, Format::R } },
+    { "srl", { Op::SRL, Format::R } }, { "sra", { Op::SRA, Format::R } },
+    { "or", { Op::OR, Format::R } }, { "and", { Op::AND, Format::R } },
+    { "mul", { Op::MUL, Format::R } }, { "mulh", { Op::MULH, Format::R } },
+    { "mulhsu", { Op::MULHSU, Format::R } }, { "mulhu", { Op::MULHU, Format::R } },
+    { "div", { Op::DIV, Format::R } }, { "divu", { Op::DIVU, Format::R } },
+    { "rem", { Op::REM, Format::R } }, { "remu", { Op::REMU, Format::R } },
+    { "sgt", { Op::SGT, Format::R } }, { "sgtu", { Op::SGTU, Format::R } },
+    { "addi", { Op::ADDI, Format::I } }, { "slti", { Op::SLTI, Format::I } },
+    { "sltiu", { Op::SLTIU, Format::I } }, { "xori", { Op::XORI, Format::I } },
+    { "ori", { Op::ORI, Format::I } }, { "andi", { Op::ANDI, Format::I } },
+    { "slli", { Op::SLLI, Format::I } }, { "srli", { Op::SRLI, Format::I } },
+    { "srai", { Op::SRAI, Format::I } },
+    { "lui", { Op::LUI, Format::U } }, { "auipc", { Op::AUIPC, Format::U } },
+    { "li", { Op::LI, Format::U } },
+    { "lb", { Op::LB, Format::LOAD } }, { "lh", { Op::LH, Format::LOAD } },
+    { "lw", { Op::LW, Format::LOAD } }, { "lbu", { Op::LBU, Format::LOAD } },
+    { "lhu", { Op::LHU, Format::LOAD } },
+    { "sb", { Op::SB, Format::STORE } }, { "sh", { Op::SH, Format::STORE } },
+    { "sw", { Op::SW, Format::STORE } },
+    { "beq", { Op::BEQ, Format::BRANCH } }, { "bne", { Op::BNE, Format::BRANCH } },
+    { "blt", { Op::BLT, Format::BRANCH } }, { "bge", { Op::BGE, Format::BRANCH } },
+    { "bltu", { Op::BLTU, Format::BRANCH } }, { "bgeu", { Op::BGEU, Format::BRANCH } },
+    { "bgt", { Op::BGT, Format::BRANCH } }, { "ble", { Op::BLE, Format::BRANCH } },
+    { "bgtu", { Op::BGTU, Format::BRANCH } }, { "bleu", { Op::BLEU, Format::BRANCH } },
+    { "beqz", { Op::BEQZ, Format::BRANCH_ZERO } }, { "bnez", { Op::BNEZ, Format::BRANCH_ZERO } },
+    { "blez", { Op::BLEZ, Format::BRANCH_ZERO } }, { "bgez", { Op::BGEZ, Format::BRANCH_ZERO } },
+    { "bltz", { Op::BLTZ, Format::BRANCH_ZERO } }, { "bgtz", { Op::BGTZ, Format::BRANCH_ZERO } },
+    { "mv", { Op::MV, Format::RR } }, { "not", { Op::NOT, Format::RR } },
+    { "neg", { Op::NEG, Format::RR } }, { "seqz", { Op::SEQZ, Format::RR } },
+    { "snez", { Op::SNEZ, Format::RR } }, { "sltz", { Op::SLTZ, Format::RR } },
+    { "sgtz", { Op::SGTZ, Format::RR } },
+    { "la", { Op::LA, Format::LABEL_RD } },
+    { "j", { Op::J, Format::LABEL } }, { "call", { Op::CALL, Format::LABEL } },
+    { "jal", { Op::JAL, Format::JAL } }, { "jalr", { Op::JALR, Format::JALR } },
+    { "jr", { Op::JR, Format::REG } },
+    { "ret", { Op::RET, Format::NONE } }, { "nop", { Op::NOP, Format::NONE } },
+    { "rdcycle", { Op::RDCYCLE, Format::RD } }, { "rdinstret", { Op::RDINSTRET, Format::RD } },
+};
+
+/**
+ * @brief 解析后的指令
+ * @note 跳转目标在全部解析完成后由 label 解析为地址，存入 imm
+ */
+struct Inst {
+    Op op;
+    int rd = 0, rs1 = 0, rs2 = 0;
+    int32_t imm = 0;
+    string label;
+    // 源文件行号，用于报错
+    int line = 0;
+};
+
+/**
+ * @brief 解析寄存器名，支持 ABI 名与 x0-x31
+ * @return 寄存器编号，不是寄存器时为 -1
+ */
+static int parse_reg(const string& name) {
+    static const unordered_map<string, int> regs = {
+        { "zero", 0 }, { "ra", 1 }, { "sp", 2 }, { "gp", 3 }, { "tp", 4 },
+        { "t0", 5 }, { "t1", 6 }, { "t2", 7 }, { "s0", 8 }, { "fp", 8 }, { "s1", 9 },
+        { "a0", 10 }, { "a1", 11 }, { "a2", 12 }, { "a3", 13 }, { "a4", 14 }, { "a5", 15 },
+        { "a6", 16 }, { "a7", 17 }, { "s2", 18 }, { "s3", 19 }, { "s4", 20 }, { "s5", 21 },
+        { "s6", 22 }, { "s7", 23 }, { "s8", 24 }, { "s9", 25 }, { "s10", 26 }, { "s11", 27 },
+        { "t3", 28 }, { "t4", 29 }, { "t5", 30 }, { "t6", 31 },
+    };
+    auto it = regs.find(name);
+    if (it != regs.end()) {
+        return it->second;
+    }
+    if (name.size() >= 2 && name[0] == 'x') {
+        char* end;
+        long index = strtol(name.c_str() + 1, &end, 10);
+        if (*end == '\0' && index >= 0 && index < 32) {
+            return (int)index;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 模拟器，包含程序、内存、寄存器与统计信息
+ */
+class Simulator {
+private:
+    // 代码段起始地址，每条指令占 4 字节
+    static constexpr uint32_t text_base = 0x00010000;
+    // 数据段起始地址
+    static constexpr uint32_t data_base = 0x10000000;
+    // 返回到该地址时程序结束
+    static constexpr uint32_t exit_address = 0xfffffff0;
+
+    vector<Inst> text;
+    vector<uint8_t> data;
+    unordered_map<string, uint32_t> labels;
+    // 栈内存，位于地址空间顶部
+    vector<uint8_t> stack;
+    uint32_t stack_base;
+    int32_t regs[32] = {};
+    uint32_t pc = 0;
+    string error;
+
+    bool fail(int line, const string& message) {
+        error = "line " + to_string(line) + ": " + message;
+        return false;
+    }
+
+    uint8_t* address(uint32_t addr, uint32_t size);
+    int32_t load(uint32_t addr, uint32_t size, bool is_signed);
+    void store(uint32_t addr, uint32_t size, int32_t value);
+    bool parse_inst(const string& mnemonic, const vector<string>& operands, Inst& inst);
+    bool call_library(const string& name);
+public:
+    // 统计信息
+    uint64_t instructions = 0;
+    uint64_t loads = 0;
+    uint64_t stores = 0;
+    uint64_t branches = 0;
+    uint64_t taken_branches = 0;
+    uint64_t jumps = 0;
+    uint64_t muls = 0;
+    uint64_t divs = 0;
+    uint64_t calls = 0;
+    uint64_t max_instructions = 0;
+
+    explicit Simulator(size_t stack_size) : stack(stack_size), stack_base((uint32_t)(0x80000000u - stack_size)) {}
+
+    const string& last_error() const { return error; }
+    bool assemble(istream& input);
+    bool run(const string& entry, int32_t& exit_code);
+    uint64_t cycles() const;
+};
+
+/**
+ * @brief 将汇编文本解析为指令与数据
+ * @param[in] input 汇编文本
+ * @return 是否解析成功
+ */
+bool Simulator::assemble(istream& input) {
+    bool in_text = true;
+    string line;
+    int line_no = 0;
+    while (getline(input, line)) {
+        ++line_no;
+        auto comment = line.find('#');
+        if (comment != string::npos) {
+            line.erase(comment);
+        }
+        // 标签，可以与指令写在同一行
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos) {
+            continue;
+        }
+        line = line.substr(start);
+        auto colon = line.find(':');
+        while (colon != string::npos && line.find_first_of(" \t,(") > colon) {
+            auto name = line.substr(0, colon);
+            labels[name] = in_text ? text_base + (uint32_t)text.size() * 4 : data_base + (uint32_t)data.size();
+            line = line.substr(colon + 1);
+            start = line.find_first_not_of(" \t\r");
+            line = start == string::npos ? "" : line.substr(start);
+            colon = line.find(':');
+        }
+        if (line.empty()) {
+            continue;
+        }
+        // 助记符与操作数
+        auto space = line.find_first_of(" \t");
+        string mnemonic = line.substr(0, space);
+        vector<string> operands;
+        if (space != string::npos) {
+            stringstream ss(line.substr(space));
+            string operand;
+            while (getline(ss, operand, ',')) {
+                auto first = operand.find_first_not_of(" \t\r");
+                auto last = operand.find_last_not_of(" \t\r");
+                operands.push_back(first == string::npos ? "" : operand.substr(first, last - first + 1));
+            }
+        }
+        // 伪操作
+        if (mnemonic[0] == '.') {
+            if (mnemonic == ".text") {
+                in_text = true;
+            }
+            else if (mnemonic == ".data" || mnemonic == ".bss" || mnemonic == ".rodata") {
+                in_text = false;
+            }
+            else if (mnemonic == ".word") {
+                for (auto& operand : operands) {
+                    int32_t value = (int32_t)strtoll(operand.c_str(), nullptr, 0);
+                    for (int i = 0; i < 4; ++i) {
+                        data.push_back((uint8_t)(value >> (8 * i)));
+                    }
+                }
+            }
+            else if (mnemonic == ".asciz" || mnemonic == ".string") {
+                // 字符串中不含逗号与转义字符，取引号之间的内容
+                auto open = line.find('"');
+                auto close = line.rfind('"');
+                if (open == string::npos || close == open) {
+                    return fail(line_no, "bad string literal");
+                }
+                data.insert(data.end(), line.begin() + open + 1, line.begin() + close);
+                data.push_back(0);
+            }
+            else if (mnemonic == ".zero" || mnemonic == ".space") {
+                if (operands.empty()) {
+                    return fail(line_no, "missing operand");
+                }
+                data.resize(data.size() + strtoul(operands.at(0).c_str(), nullptr, 0));
+            }
+            else if (mnemonic == ".align" || mnemonic == ".p2align") {
+                if (operands.empty()) {
+                    return fail(line_no, "missing operand");
+                }
+                size_t align = (size_t)1 << strtoul(operands.at(0).c_str(), nullptr, 0);
+                data.resize((data.size() + align - 1) / align * align);
+            }
+            // .globl .section .type .size 等不影响执行
+            continue;
+        }
+        Inst inst;
+        inst.line = line_no;
+        if (!parse_inst(mnemonic, operands, inst)) {
+            return false;
+        }
+        text.push_back(inst);
+    }
+    // 解析跳转目标
+    for (auto& inst : text) {
+        if (inst.label.empty()) {
+            continue;
+        }
+        auto it = labels.find(inst.label);
+        if (it != labels.end()) {
+            inst.imm = (int32_t)it->second;
+        }
+        else if (inst.op != Op::CALL) {
+            return fail(inst.line, "undefined label " + inst.label);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 解析一条指令的操作数
+ * @param[in] mnemonic 助记符
+ * @param[in] operands 操作数
+ * @param[out] inst 指令
+ * @return 是否解析成功
+ */
+bool Simulator::parse_inst(const string& mnemonic, const vector<string>& operands, Inst& inst) {
+    auto it = op_table.find(mnemonic);
+    if (it == op_table.end()) {
+        return fail(inst.line, "unknown instruction " + mnemonic);
+    }
+    inst.op = it->second.op;
+    auto reg = [&](size_t index, int& out) {
+        out = index < operands.size() ? parse_reg(operands[index]) : -1;
+        return out >= 0 || fail(inst.line, "bad register operand in " + mnemonic);
+    };
+    auto imm = [&](size_t index) {
+        return index < operands.size() ? (int32_t)strtoll(operands[index].c_str(), nullptr, 0) : 0;
+    };
+    // imm(reg) 形式的内存操作数
+    auto mem = [&](size_t index) {
+        if (index >= operands.size()) {
+            return fail(inst.line, "missing memory operand in " + mnemonic);
+        }
+        auto& operand = operands[index];
+        auto open = operand.find('(');
+        auto close = operand.find(')');
+        if (open == string::npos || close == string::npos) {
+            return fail(inst.line, "bad memory operand " + operand);
+        }
+        inst.imm = open == 0 ? 0 : (int32_t)strtoll(operand.substr(0, open).c_str(), nullptr, 0);
+        inst.rs1 = parse_reg(operand.substr(open + 1, close - open - 1));
+        return inst.rs1 >= 0 || fail(inst.line, "bad register in " + operand);
+    };
+    auto label = [&](size_t index) {
+        if (index >= operands.size() || operands[index].empty()) {
+            return fail(inst.line, "missing label in " + mnemonic);
+        }
+        inst.label = operands[index];
+        return true;
+    };
+    switch (it->second.format) {
+    case Format::R:
+        return reg(0, inst.rd) && reg(1, inst.rs1) && reg(2, inst.rs2);
+    case Format::I:
+        inst.imm = imm(2);
+        return reg(0, inst.rd) && reg(1, inst.rs1);
+    case Format::U:
+        inst.imm = imm(1);
+        return reg(0, inst.rd);
+    case Format::LOAD:
+        return reg(0, inst.rd) && mem(1);
+    case Format::STORE:
+        return reg(0, inst.rs2) && mem(1);
+    case Format::BRANCH:
+        return reg(0, inst.rs1) && reg(1, inst.rs2) && label(2);
+    case Format::BRANCH_ZERO:
+        return reg(0, inst.rs1) && label(1);
+    case Format::RR:
+        return reg(0, inst.rd) && reg(1, inst.rs1);
+    case Format::LABEL_RD:
+        return reg(0, inst.rd) && label(1);
+    case Format::LABEL:
+        return label(0);
+    case Format::JAL:
+        if (operands.size() == 1) {
+            inst.rd = 1;
+            return label(0);
+        }
+        return reg(0, inst.rd) && label(1);
+    case Format::JALR:
+        if (operands.size() == 1) {
+            inst.rd = 1;
+            return operands[0].find('(') != string::npos ? mem(0) : reg(0, inst.rs1);
+        }
+        return reg(0, inst.rd) && (operands[1].find('(') != string::npos ? mem(1) : reg(1, inst.rs1));
+    case Format::REG:
+        return reg(0, inst.rs1);
+    case Format::RD:
+        return reg(0, inst.rd);
+    case Format::NONE:
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 将地址翻译为模拟内存中的指针
+ * @return 指针，越界时为空
+ */
+uint8_t* Simulator::address(uint32_t addr, uint32_t size) {
+    if (addr >= data_base && addr + size <= data_base + data.size()) {
+        return &data[addr - data_base];
+    }
+    if (addr >= stack_base && addr + size <= stack_base + stack.size()) {
+        return &stack[addr - stack_base];
+    }
+    return nullptr;
+}
+
+int32_t Simulator::load(uint32_t addr, uint32_t size, bool is_signed) {
+    auto ptr = address(addr, size);
+    if (ptr == nullptr) {
+        throw runtime_error("load from invalid address " + to_string(addr));
+    }
+    uint32_t value = 0;
+    memcpy(&value, ptr, size);
+    if (is_signed && size < 4) {
+        uint32_t shift = 32 - size * 8;
+        return (int32_t)(value << shift) >> shift;
+    }
+    return (int32_t)value;
+}
+
+void Simulator::store(uint32_t addr, uint32_t size, int32_t value) {
+    auto ptr = address(addr, size);
+    if (ptr == nullptr) {
+        throw runtime_error("store to invalid address " + to_string(addr));
+    }
+    memcpy(ptr, &value, size);
+}
+
+/**
+ * @brief 执行 SysY 运行时库函数
+ * @param[in] name 函数名
+ * @return 是否为已知的库函数
+ * @note 数组参数通过模拟内存读写，计时函数只输出提示
+ */
+bool Simulator::call_library(const string& name) {
+    int32_t& a0 = regs[10];
+    if (name == "getint") {
+        if (scanf("%d", &a0) != 1) {
+            a0 = 0;
+        }
+    }
+    else if (name == "getch") {
+        a0 = getchar();
+    }
+    else if (name == "getarray") {
+        int32_t n = 0;
+        if (scanf("%d", &n) != 1) {
+            n = 0;
+        }
+        for (int32_t i = 0; i < n; ++i) {
+            int32_t value = 0;
+            if (scanf("%d", &value) != 1) {
+                value = 0;
+            }
+            store((uint32_t)a0 + i * 4, 4, value);
+        }
+        a0 = n;
+    }
+    else if (name == "putint") {
+        printf("%d", a0);
+    }
+    else if (name == "putch") {
+        putchar(a0);
+    }
+    else if (name == "putarray") {
+        printf("%d:", a0);
+        for (int32_t i = 0; i < a0; ++i) {
+            printf(" %d", load((uint32_t)regs[11] + i * 4, 4, true));
+        }
+        putchar('\n');
+    }
+    else if (name == "starttime" || name == "stoptime" || name == "_sysy_starttime" || name == "_sysy_stoptime") {
+        // 模拟器以指令数衡量性能，计时函数不做任何事
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 从入口函数开始执行，直到入口函数返回
+ * @param[in] entry 入口函数名
+ * @param[out] exit_code 入口函数的返回值
+ * @return 是否正常结束
+ */
+bool Simulator::run(const string& entry, int32_t& exit_code) {
+    auto it = labels.find(entry);
+    if (it == labels.end()) {
+        error = "entry " + entry + " not found";
+        return false;
+    }
+    pc = it->second;
+    regs[1] = (int32_t)exit_address;
+    regs[2] = (int32_t)(stack_base + stack.size());
+    try {
+        while (pc != exit_address) {
+            uint32_t index = (pc - text_base) / 4;
+            if (pc < text_base || pc % 4 != 0 || index >= text.size()) {
+                error = "jump to invalid address " + to_string(pc);
+                return false;
+            }
+            if (max_instructions != 0 && instructions >= max_instructions) {
+                error = "instruction limit reached";
+                return false;
+            }
+            auto& inst = text[index];
+            auto rs1 = regs[inst.rs1];
+            auto rs2 = regs[inst.rs2];
+            auto u1 = (uint32_t)rs1;
+            auto u2 = (uint32_t)rs2;
+            int32_t result = 0;
+            bool write = true;
+            uint32_t next = pc + 4;
+            // 条件分支是否跳转
+            int taken = -1;
+            ++instructions;
+            switch (inst.op) {
+            case Op::ADD: result = (int32_t)(u1 + u2); break;
+            case Op::SUB: result = (int32_t)(u1 - u2); break;
+            case Op::SLL: result = (int32_t)(u1 << (u2 & 31)); break;
+            case Op::SLT: result = rs1 < rs2; break;
+            case Op::SLTU: result = u1 < u2; break;
+            case Op::SGT: result = rs1 > rs2; break;
+            case Op::SGTU: result = u1 > u2; break;
+            case Op::XOR: result = rs1 ^ rs2; break;
+            case Op::SRL: result = (int32_t)(u1 >> (u2 & 31)); break;
+            case Op::SRA: result = rs1 >> (u2 & 31); break;
+            case Op::OR: result = rs1 | rs2; break;
+            case Op::AND: result = rs1 & rs2; break;
+            case Op::MUL: ++muls; result = (int32_t)(u1 * u2); break;
+            case Op::MULH: ++muls; result = (int32_t)(((int64_t)rs1 * rs2) >> 32); break;
+            case Op::MULHSU: ++muls; result = (int32_t)(((int64_t)rs1 * (int64_t)u2) >> 32); break;
+            case Op::MULHU: ++muls; result = (int32_t)(((uint64_t)u1 * u2) >> 32); break;
+            case Op::DIV:
+                ++divs;
+                result = rs2 == 0 ? -1 : (rs1 == INT32_MIN && rs2 == -1) ? rs1 : rs1 / rs2;
+                break;
+            case Op::DIVU: ++divs; result = u2 == 0 ? -1 : (int32_t)(u1 / u2); break;
+            case Op::REM:
+                ++divs;
+                result = rs2 == 0 ? rs1 : (rs1 == INT32_MIN && rs2 == -1) ? 0 : rs1 % rs2;
+                break;
+            case Op::REMU: ++divs; result = u2 == 0 ? rs1 : (int32_t)(u1 % u2); break;
+            case Op::ADDI: result = (int32_t)(u1 + (uint32_t)inst.imm); break;
+            case Op::SLTI: result = rs1 < inst.imm; break;
+            case Op::SLTIU: result = u1 < (uint32_t)inst.imm; break;
+            case Op::XORI: result = rs1 ^ inst.imm; break;
+            case Op::ORI: result = rs1 | inst.imm; break;
+            case Op::ANDI: result = rs1 & inst.imm; break;
+            case Op::SLLI: result = (int32_t)(u1 << (inst.imm & 31)); break;
+            case Op::SRLI: result = (int32_t)(u1 >> (inst.imm & 31)); break;
+            case Op::SRAI: result = rs1 >> (inst.imm & 31); break;
+            case Op::LUI: result = (int32_t)((uint32_t)inst.imm << 12); break;
+            case Op::AUIPC: result = (int32_t)(pc + ((uint32_t)inst.imm << 12)); break;
+            case Op::LI:
+                result = inst.imm;
+                // 超出 12 位的立即数展开为 lui + addi
+                if (inst.imm < -2048 || inst.imm > 2047) {
+                    ++instructions;
+                }
+                break;
+            case Op::LA: ++instructions; result = inst.imm; break;
+            case Op::MV: result = rs1; break;
+            case Op::NOT: result = ~rs1; break;
+            case Op::NEG: result = (int32_t)(0u - u1); break;
+            case Op::SEQZ: result = rs1 == 0; break;
+            case Op::SNEZ: result = rs1 != 0; break;
+            case Op::SLTZ: result = rs1 < 0; break;
+            case Op::SGTZ: result = rs1 > 0; break;
+            case Op::LB: ++loads; result = load(u1 + inst.imm, 1, true); break;
+            case Op::LH: ++loads; result = load(u1 + inst.imm, 2, true); break;
+            case Op::LW: ++loads; result = load(u1 + inst.imm, 4, true); break;
+            case Op::LBU: ++loads; result = load(u1 + inst.imm, 1, false); break;
+            case Op::LHU: ++loads; result = load(u1 + inst.imm, 2, false); break;
+            case Op::SB: ++stores; write = false; store(u1 + inst.imm, 1, rs2); break;
+            case Op::SH: ++stores; write = false; store(u1 + inst.imm, 2, rs2); break;
+            case Op::SW: ++stores; write = false; store(u1 + inst.imm, 4, rs2); break;
+            case Op::BEQ: taken = rs1 == rs2; break;
+            case Op::BNE: taken = rs1 != rs2; break;
+            case Op::BLT: taken = rs1 < rs2; break;
+            case Op::BGE: taken = rs1 >= rs2; break;
+            case Op::BLTU: taken = u1 < u2; break;
+            case Op::BGEU: taken = u1 >= u2; break;
+            case Op::BGT: taken = rs1 > rs2; break;
+            case Op::BLE: taken = rs1 <= rs2; break;
+            case Op::BGTU: taken = u1 > u2; break;
+            case Op::BLEU: taken = u1 <= u2; break;
+            case Op::BEQZ: taken = rs1 == 0; break;
+            case Op::BNEZ: taken = rs1 != 0; break;
+            case Op::BLEZ: taken = rs1 <= 0; break;
+            case Op::BGEZ: taken = rs1 >= 0; break;
+            case Op::BLTZ: taken = rs1 < 0; break;
+            case Op::BGTZ: taken = rs1 > 0; break;
+            case Op::J:
+                ++jumps;
+                write = false;
+                next = (uint32_t)inst.imm;
+                break;
+            case Op::JAL:
+                ++jumps;
+                result = (int32_t)next;
+                next = (uint32_t)inst.imm;
+                break;
+            case Op::JALR:
+                ++jumps;
+                result = (int32_t)next;
+                next = (u1 + (uint32_t)inst.imm) & ~1u;
+                break;
+            case Op::JR:
+            case Op::RET:
+                ++jumps;
+                write = false;
+                next = inst.op == Op::RET ? (uint32_t)regs[1] : u1;
+                break;
+            case Op::CALL:
+                // 与 la 一样展开为 auipc + jalr
+                ++instructions;
+                ++calls;
+                ++jumps;
+                write = false;
+                if (labels.count(inst.label)) {
+                    regs[1] = (int32_t)next;
+                    next = (uint32_t)inst.imm;
+                }
+                else if (!call_library(inst.label)) {
+                    error = "undefined function " + inst.label;
+                    return false;
+                }
+                break;
+            case Op::NOP:
+                write = false;
+                break;
+            // 计数器读到的是执行到该指令之前的值
+            case Op::RDCYCLE: result = (int32_t)(cycles() - 1); break;
+            case Op::RDINSTRET: result = (int32_t)(instructions - 1); break;
+            }
+            if (taken >= 0) {
+                ++branches;
+                write = false;
+                if (taken) {
+                    ++taken_branches;
+                    next = (uint32_t)inst.imm;
+                }
+            }
+            if (write && inst.rd != 0) {
+                regs[inst.rd] = result;
+            }
+            pc = next;
+        }
+    }
+    catch (const runtime_error& e) {
+        error = e.what();
+        return false;
+    }
+    exit_code = regs[10];
+    return true;
+}
+
+/**
+ * @brief 估计周期数
+ * @note 简单的单发射顺序流水线模型：每条指令 1 周期，load 额外 1 周期，
+ * @note 乘法额外 2 周期，除法与取余额外 32 周期，跳转与跳转的分支额外 2 周期
+ */
+uint64_t Simulator::cycles() const {
+    return instructions + loads + muls * 2 + divs * 32 + (jumps + taken_branches) * 2;
+}
+
+// 模拟器自身出错时的退出码, 与 git bisect run 的 "跳过" 相同, 测试程序的返回值很少用到
+static constexpr int sim_error_status = 125;
+
+int main(int argc, const char* argv[]) {
+    bool quiet = false;
+    // 栈位于 0x80000000 之下，大小为 1 ~ 2047 MiB
+    size_t memory_mib = 16;
+    uint64_t max_instructions = 0;
+    const char* path = nullptr;
+    bool bad_option = false;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "-q") {
+            quiet = true;
+        }
+        else if (option == "-m" && i + 1 < argc) {
+            char* end;
+            memory_mib = strtoul(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || memory_mib < 1 || memory_mib > 2047) {
+                cerr << "error: -m must be between 1 and 2047" << endl;
+                bad_option = true;
+            }
+        }
+        else if (option == "-max" && i + 1 < argc) {
+            max_instructions = strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr || bad_option) {
+        cerr << "usage: " << argv[0] << " [-q] [-m MiB] [-max N] file.S" << endl;
+        return sim_error_status;
+    }
+    ifstream input(path);
+    if (!input) {
+        cerr << "error: cannot open " << path << endl;
+        return sim_error_status;
+    }
+
+    Simulator sim(memory_mib << 20);
+    sim.max_instructions = max_instructions;
+    if (!sim.assemble(input)) {
+        cerr << "error: " << sim.last_error() << endl;
+        return sim_error_status;
+    }
+    int32_t exit_code = 0;
+    auto start = chrono::steady_clock::now();
+    bool ok = sim.run("main", exit_code);
+    auto end = chrono::steady_clock::now();
+    fflush(stdout);
+    if (!ok) {
+        cerr << "error: " << sim.last_error() << endl;
+        return sim_error_status;
+    }
+    if (!quiet) {
+        double seconds = chrono::duration<double>(end - start).count();
+        fprintf(stderr, "exit code: %d\n", exit_code);
+        fprintf(stderr, "instructions: %llu\n", (unsigned long long)sim.instructions);
+        fprintf(stderr, "loads: %llu\n", (unsigned long long)sim.loads);
+        fprintf(stderr, "stores: %llu\n", (unsigned long long)sim.stores);
+        fprintf(stderr, "branches: %llu\n", (unsigned long long)sim.branches);
+        fprintf(stderr, "taken branches: %llu\n", (unsigned long long)sim.taken_branches);
+        fprintf(stderr, "jumps: %llu\n", (unsigned long long)sim.jumps);
+        fprintf(stderr, "calls: %llu\n", (unsigned long long)sim.calls);
+        fprintf(stderr, "mul: %llu\n", (unsigned long long)sim.muls);
+        fprintf(stderr, "div/rem: %llu\n", (unsigned long long)sim.divs);
+        fprintf(stderr, "estimated cycles: %llu\n", (unsigned long long)sim.cycles());
+        fprintf(stderr, "simulation speed: %.1f MIPS\n", seconds > 0 ? sim.instructions / seconds / 1e6 : 0.0);
+    }
+    return exit_code & 0xff;
+}